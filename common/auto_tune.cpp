@@ -0,0 +1,331 @@
+#include "auto_tune.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <boost/filesystem.hpp>
+#include <cuda_runtime.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define AUTO_TUNE_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+
+namespace
+{
+	// ۑt@Č`ςグ
+	const char FileHeader[] = "waifu2x-caffe auto tune 2";
+
+	std::string GetCPUName()
+	{
+#ifdef AUTO_TUNE_X86
+		unsigned int regs[12];
+		memset(regs, 0, sizeof(regs));
+
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0x80000000);
+		if ((unsigned int)info[0] < 0x80000004)
+			return "unknown";
+
+		for (int i = 0; i < 3; i++)
+		{
+			__cpuid(info, 0x80000002 + i);
+			memcpy(regs + i * 4, info, sizeof(info));
+		}
+#else
+		if (__get_cpuid_max(0x80000000, nullptr) < 0x80000004)
+			return "unknown";
+
+		for (int i = 0; i < 3; i++)
+			__get_cpuid(0x80000002 + i, &regs[i * 4], &regs[i * 4 + 1], &regs[i * 4 + 2], &regs[i * 4 + 3]);
+#endif
+
+		char name[sizeof(regs) + 1];
+		memcpy(name, regs, sizeof(regs));
+		name[sizeof(regs)] = '\0';
+
+		std::string str(name);
+		const auto begin = str.find_first_not_of(' ');
+		const auto end = str.find_last_not_of(' ');
+		if (begin == std::string::npos)
+			return "unknown";
+
+		return str.substr(begin, end - begin + 1);
+#else
+		return "unknown";
+#endif
+	}
+
+	// L[Ƀ^uƉsƃt@Č`̂ŋ󔒂ɂ
+	std::string Sanitize(std::string str)
+	{
+		std::replace(str.begin(), str.end(), '\t', ' ');
+		std::replace(str.begin(), str.end(), '\r', ' ');
+		std::replace(str.begin(), str.end(), '\n', ' ');
+
+		return str;
+	}
+
+	// vɎg摜Bf̒lŏx͕ςȂ͂A񓯂摜ɂȂ悤ɂĂ
+	cv::Mat CreateTuneImage(const int size)
+	{
+		cv::Mat im(size, size, CV_8UC3);
+
+		cv::RNG rng(0x5eed);
+		rng.fill(im, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(256));
+
+		return im;
+	}
+}
+
+Waifu2xAutoTune::stOption::stOption() : memory_budget_mb(0), image_size(512), iterations(3)
+{
+	const int CropSizes[] = { 64, 96, 128, 192, 256 };
+	const int BatchSizes[] = { 1, 2, 4, 8 };
+
+	crop_sizes.assign(CropSizes, CropSizes + sizeof(CropSizes) / sizeof(CropSizes[0]));
+	batch_sizes.assign(BatchSizes, BatchSizes + sizeof(BatchSizes) / sizeof(BatchSizes[0]));
+}
+
+std::string Waifu2xAutoTune::GetHardwareFingerprint(const std::string &process)
+{
+	std::string fingerprint = GetCPUName() + " x" + std::to_string(std::max((int)std::thread::hardware_concurrency(), 1));
+
+	if (process == "gpu" || process == "cudnn")
+	{
+		int device = 0;
+		cudaDeviceProp prop;
+		if (cudaGetDevice(&device) == cudaSuccess && cudaGetDeviceProperties(&prop, device) == cudaSuccess)
+			fingerprint += " / " + std::string(prop.name) + " " + std::to_string((unsigned long long)(prop.totalGlobalMem >> 20)) + "MB";
+		else
+			fingerprint += " / no gpu";
+	}
+
+	return Sanitize(fingerprint);
+}
+
+std::string Waifu2xAutoTune::GetDefaultPath(const std::string &cache_dir)
+{
+	boost::filesystem::path dir(cache_dir);
+	if (cache_dir.empty())
+	{
+		boost::system::error_code error;
+		dir = boost::filesystem::temp_directory_path(error) / "waifu2x-caffe";
+	}
+
+	return (dir / "auto_tune.txt").string();
+}
+
+std::string Waifu2xAutoTune::GetKey(const std::string &model_dir, const std::string &mode, const std::string &process, const Waifu2x::InitOption &init_option)
+{
+	const std::string model = boost::filesystem::absolute(model_dir).string();
+
+	// native͌vZ̐xŁAcpunative̓Xbh̐ňԑgݍ킹ς
+	std::string proc = process;
+	if (process == "native")
+		proc += ":" + init_option.native_precision;
+	if (process == "cpu" || process == "native")
+		proc += ":" + std::to_string(init_option.cpu_thread_num);
+
+	// modeŎglbg[N̐(mCYƊg)ς
+	return Sanitize(model + "|" + mode + "|" + proc + "|" + GetHardwareFingerprint(process));
+}
+
+bool Waifu2xAutoTune::Load(const std::string &path, const std::string &key, stResult &result)
+{
+	std::ifstream ifs(path.c_str());
+	if (!ifs)
+		return false;
+
+	std::string line;
+	if (!std::getline(ifs, line) || line != FileHeader)
+		return false;
+
+	while (std::getline(ifs, line))
+	{
+		const auto pos = line.find('\t');
+		if (pos == std::string::npos || line.substr(0, pos) != key)
+			continue;
+
+		stResult r;
+		std::istringstream iss(line.substr(pos + 1));
+		if (!(iss >> r.crop_size >> r.batch_size >> r.mpixel_per_sec))
+			return false;
+
+		if (r.crop_size <= 0 || r.batch_size <= 0)
+			return false;
+
+		result = r;
+		return true;
+	}
+
+	return false;
+}
+
+bool Waifu2xAutoTune::Save(const std::string &path, const std::string &key, const stResult &result)
+{
+	// ̃L[̌ʂ͎c
+	std::vector<std::string> lines;
+	{
+		std::ifstream ifs(path.c_str());
+
+		std::string line;
+		if (ifs && std::getline(ifs, line) && line == FileHeader)
+		{
+			while (std::getline(ifs, line))
+			{
+				const auto pos = line.find('\t');
+				if (pos != std::string::npos && line.substr(0, pos) != key)
+					lines.push_back(line);
+			}
+		}
+	}
+
+	char buf[128];
+	sprintf(buf, "\t%d\t%d\t%.3f", result.crop_size, result.batch_size, result.mpixel_per_sec);
+	lines.push_back(key + buf);
+
+	boost::system::error_code error;
+
+	const boost::filesystem::path file(path);
+	boost::filesystem::create_directories(file.parent_path(), error);
+
+	const boost::filesystem::path temp = file.parent_path() / boost::filesystem::unique_path(file.filename().string() + ".%%%%%%%%.tmp", error);
+	if (error)
+		return false;
+
+	{
+		std::ofstream ofs(temp.string().c_str());
+		if (!ofs)
+			return false;
+
+		ofs << FileHeader << "\n";
+		for (const auto &l : lines)
+			ofs << l << "\n";
+
+		ofs.close();
+		if (!ofs)
+		{
+			boost::filesystem::remove(temp, error);
+			return false;
+		}
+	}
+
+	boost::filesystem::rename(temp, file, error);
+	if (error)
+	{
+		boost::filesystem::remove(temp, error);
+		return false;
+	}
+
+	return true;
+}
+
+bool Waifu2xAutoTune::IsInBudget(const int crop_size, const int batch_size, const std::string &process, const int cpu_thread_num, const int memory_budget_mb)
+{
+	if (memory_budget_mb <= 0)
+		return true;
+
+	uint64_t host_bytes = 0;
+	uint64_t device_bytes = 0;
+	Waifu2x::EstimateNetMemory(crop_size, batch_size, process, cpu_thread_num, 3, host_bytes, device_bytes);
+
+	const uint64_t bytes = process == "gpu" || process == "cudnn" ? device_bytes : host_bytes;
+
+	return bytes <= (uint64_t)memory_budget_mb << 20;
+}
+
+Waifu2x::eWaifu2xError Waifu2xAutoTune::Tune(int argc, char** argv, const std::string &mode, const int noise_level, const std::string &model_dir, const std::string &process,
+	const Waifu2x::InitOption &init_option, const stOption &option, stResult &result, const progressFunc progress_func)
+{
+	const cv::Mat image = CreateTuneImage(std::max(option.image_size, 16));
+	const int Iterations = std::max(option.iterations, 1);
+
+	Waifu2x::eWaifu2xError last_error = Waifu2x::eWaifu2xError_InvalidParameter;
+	bool isFound = false;
+
+	// v(ۂɎg)gݍ킹
+	std::vector<std::pair<int, int>> measured;
+
+	for (const int crop_size : option.crop_sizes)
+	{
+		for (const int batch_size : option.batch_sizes)
+		{
+			if (crop_size <= 0 || batch_size <= 0)
+				continue;
+
+			if (!IsInBudget(crop_size, batch_size, process, init_option.cpu_thread_num, option.memory_budget_mb))
+				continue;
+
+			Waifu2x w;
+			auto ret = w.init(argc, argv, mode, noise_level, 2.0, model_dir, process, crop_size, batch_size, init_option);
+			if (ret != Waifu2x::eWaifu2xError_OK)
+			{
+				last_error = ret;
+				continue;
+			}
+
+			cv::Mat out;
+
+			// 1ڂ̓lbg[N̏(GPŨ̊mۂȂ)̂ŌvȂ
+			ret = w.waifu2x(image, out);
+			if (ret != Waifu2x::eWaifu2xError_OK)
+			{
+				last_error = ret;
+				continue;
+			}
+
+			// init_optioñ̏ϊ̃sŃubNȂĂ邱Ƃ̂ŁAۂɎgĂgݍ킹ŋL^
+			// Ȃʂvς݂̑gݍ킹ƓȂvȂ
+			const std::pair<int, int> used(w.used_crop_size(), w.used_batch_size());
+			if (std::find(measured.begin(), measured.end(), used) != measured.end())
+				continue;
+
+			const auto StartTime = std::chrono::high_resolution_clock::now();
+
+			for (int i = 0; i < Iterations && ret == Waifu2x::eWaifu2xError_OK; i++)
+				ret = w.waifu2x(image, out);
+
+			const auto EndTime = std::chrono::high_resolution_clock::now();
+
+			if (ret != Waifu2x::eWaifu2xError_OK)
+			{
+				last_error = ret;
+				continue;
+			}
+
+			// vɃubNȂAǂ̑gݍ킹̑xłȂ̂ŎgȂ
+			if (w.used_crop_size() != used.first || w.used_batch_size() != used.second)
+				continue;
+
+			measured.push_back(used);
+
+			const double sec = std::chrono::duration<double>(EndTime - StartTime).count();
+
+			stResult r;
+			r.crop_size = used.first;
+			r.batch_size = used.second;
+			r.mpixel_per_sec = sec > 0.0 ? (double)image.cols * image.rows * Iterations / sec / 1000000.0 : 0.0;
+
+			if (progress_func)
+				progress_func(r);
+
+			if (!isFound || r.mpixel_per_sec > result.mpixel_per_sec)
+			{
+				result = r;
+				isFound = true;
+			}
+		}
+	}
+
+	return isFound ? Waifu2x::eWaifu2xError_OK : last_error;
+}
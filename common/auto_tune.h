@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <functional>
+#include "waifu2x.h"
+
+
+// (crop_size, batch_size)̌Ŏۂɉ摜ϊďxvAԑgݍ킹I
+// ʂ(f, process, n[hEFA)Ƀt@CɕۑĂA͌vɎg
+class Waifu2xAutoTune
+{
+public:
+	struct stOption
+	{
+		// ɂcrop_sizebatch_size(SĂ̑gݍ킹v)
+		std::vector<int> crop_sizes;
+		std::vector<int> batch_sizes;
+		// lbg[ŇvZɎg(gpucudnnGPŨAȊO̓C)̏(MB)
+		// Waifu2x::EstimateNetMemory()̊TZ𒴂gݍ킹͌vȂB0Ȃ琧Ȃ
+		int memory_budget_mb;
+		// vɎg摜̈ӂ̉f
+		int image_size;
+		// v(1AvȂϊs)
+		int iterations;
+
+		stOption();
+	};
+
+	struct stResult
+	{
+		int crop_size;
+		int batch_size;
+		// ͉摜̃KsNZb
+		double mpixel_per_sec;
+
+		stResult() : crop_size(0), batch_size(0), mpixel_per_sec(0.0)
+		{
+		}
+	};
+
+	// vgݍ킹󂯎(i̕\p)
+	typedef std::function<void(const stResult &result)> progressFunc;
+
+public:
+	// CPU̖OƘ_RA(processgpucudnnȂGPU̖Oƃ̗ʂ)ׂ
+	static std::string GetHardwareFingerprint(const std::string &process);
+
+	// ʂۑt@C̈ʒuBcache_dirȂꎞtH_
+	static std::string GetDefaultPath(const std::string &cache_dir);
+
+	// ۑ鎞̃L[(f, mode, process, native̐x, CPŨXbh, n[hEFA)
+	static std::string GetKey(const std::string &model_dir, const std::string &mode, const std::string &process, const Waifu2x::InitOption &init_option);
+
+	// pathɕۑĂkey̌ʂǂݍށBfalse
+	static bool Load(const std::string &path, const std::string &key, stResult &result);
+
+	// pathkey̌ʂۑ(L[̌ʂ͒u)
+	static bool Save(const std::string &path, const std::string &key, const stResult &result);
+
+	// crop_size, batch_sizememory_budget_mbɎ܂邩
+	static bool IsInBudget(const int crop_size, const int batch_size, const std::string &process, const int cpu_thread_num, const int memory_budget_mb);
+
+	// optioňvĈԑgݍ킹resultɕԂ
+	// █Waifu2x̂ŁAϊɎs(ȂȂ)gݍ킹͔΂BSĎs炻̌Ԃ
+	// init_optioñ̏ȂǂŃubNȂ́AۂɎggݍ킹vʂɂ
+	static Waifu2x::eWaifu2xError Tune(int argc, char** argv, const std::string &mode, const int noise_level, const std::string &model_dir, const std::string &process,
+		const Waifu2x::InitOption &init_option, const stOption &option, stResult &result, const progressFunc progress_func = nullptr);
+};
@@ -0,0 +1,248 @@
+#include "model_cache.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/crc.hpp>
+
+
+namespace
+{
+	const char CacheMagic[8] = { 'W', '2', 'X', 'C', 'A', 'C', 'H', 'E' };
+	// `ςグ
+	const uint32_t CacheVersion = 1;
+
+	struct stCacheHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t layer_num;
+		uint64_t source_size;
+		int64_t source_mtime;
+		// wb_[̌ŜCRC32
+		uint32_t checksum;
+		uint32_t reserved;
+	};
+
+	// ew̏d݂ƃoCAX̑Oɒu
+	struct stCacheLayerHeader
+	{
+		uint32_t input_plane;
+		uint32_t output_plane;
+		uint32_t kernel_width;
+		uint32_t kernel_height;
+	};
+
+	bool GetSourceInfo(const std::string &source_path, uint64_t &size, int64_t &mtime)
+	{
+		boost::system::error_code error;
+
+		size = boost::filesystem::file_size(source_path, error);
+		if (error)
+			return false;
+
+		mtime = boost::filesystem::last_write_time(source_path, error);
+		if (error)
+			return false;
+
+		return true;
+	}
+
+	size_t GetWeightNum(const stCacheLayerHeader &l)
+	{
+		return (size_t)l.output_plane * l.input_plane * l.kernel_height * l.kernel_width;
+	}
+}
+
+struct Waifu2xModelCache::stMapping
+{
+	boost::interprocess::file_mapping file;
+	boost::interprocess::mapped_region region;
+
+	stMapping(const std::string &path) : file(path.c_str(), boost::interprocess::read_only), region(file, boost::interprocess::read_only)
+	{
+	}
+};
+
+
+Waifu2xModelCache::Waifu2xModelCache()
+{
+}
+
+Waifu2xModelCache::~Waifu2xModelCache()
+{
+}
+
+std::string Waifu2xModelCache::GetCachePath(const std::string &cache_dir, const std::string &source_path)
+{
+	const boost::filesystem::path source = boost::filesystem::absolute(source_path);
+
+	const std::string source_str = source.string();
+
+	boost::crc_32_type crc;
+	crc.process_bytes(source_str.data(), source_str.size());
+
+	char hash[16];
+	sprintf(hash, "%08x", (unsigned int)crc.checksum());
+
+	const std::string file_name = source.filename().string() + "." + hash + ".cache";
+
+	return (boost::filesystem::path(cache_dir) / file_name).string();
+}
+
+bool Waifu2xModelCache::Load(const std::string &cache_path, const std::string &source_path)
+{
+	mapping.reset();
+	layer_list.clear();
+
+	uint64_t source_size;
+	int64_t source_mtime;
+	if (!GetSourceInfo(source_path, source_size, source_mtime))
+		return false;
+
+	try
+	{
+		boost::system::error_code error;
+		if (!boost::filesystem::exists(cache_path, error))
+			return false;
+
+		boost::shared_ptr<stMapping> m(new stMapping(cache_path));
+
+		const unsigned char *ptr = (const unsigned char *)m->region.get_address();
+		const size_t size = m->region.get_size();
+
+		if (size < sizeof(stCacheHeader))
+			return false;
+
+		stCacheHeader header;
+		memcpy(&header, ptr, sizeof(header));
+
+		if (memcmp(header.magic, CacheMagic, sizeof(CacheMagic)) != 0 || header.version != CacheVersion)
+			return false;
+
+		if (header.source_size != source_size || header.source_mtime != source_mtime)
+			return false;
+
+		boost::crc_32_type crc;
+		crc.process_bytes(ptr + sizeof(header), size - sizeof(header));
+		if (crc.checksum() != header.checksum)
+			return false;
+
+		std::vector<stLayer> list;
+
+		size_t pos = sizeof(header);
+		for (uint32_t i = 0; i < header.layer_num; i++)
+		{
+			if (pos + sizeof(stCacheLayerHeader) > size)
+				return false;
+
+			stCacheLayerHeader lh;
+			memcpy(&lh, ptr + pos, sizeof(lh));
+			pos += sizeof(lh);
+
+			const size_t WeightNum = GetWeightNum(lh);
+			if (pos + (WeightNum + lh.output_plane) * sizeof(float) > size)
+				return false;
+
+			stLayer l;
+			l.input_plane = (int)lh.input_plane;
+			l.output_plane = (int)lh.output_plane;
+			l.kernel_width = (int)lh.kernel_width;
+			l.kernel_height = (int)lh.kernel_height;
+			l.weight = (const float *)(ptr + pos);
+			pos += WeightNum * sizeof(float);
+			l.bias = (const float *)(ptr + pos);
+			pos += lh.output_plane * sizeof(float);
+
+			list.push_back(l);
+		}
+
+		if (pos != size)
+			return false;
+
+		mapping = m;
+		layer_list.swap(list);
+	}
+	catch (...)
+	{
+		mapping.reset();
+		layer_list.clear();
+		return false;
+	}
+
+	return true;
+}
+
+const std::vector<Waifu2xModelCache::stLayer>& Waifu2xModelCache::layers() const
+{
+	return layer_list;
+}
+
+bool Waifu2xModelCache::Write(const std::string &cache_path, const std::string &source_path, const std::vector<stLayer> &layers)
+{
+	stCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CacheMagic, sizeof(CacheMagic));
+	header.version = CacheVersion;
+	header.layer_num = (uint32_t)layers.size();
+
+	if (!GetSourceInfo(source_path, header.source_size, header.source_mtime))
+		return false;
+
+	std::vector<unsigned char> payload;
+	for (const auto &l : layers)
+	{
+		stCacheLayerHeader lh;
+		lh.input_plane = (uint32_t)l.input_plane;
+		lh.output_plane = (uint32_t)l.output_plane;
+		lh.kernel_width = (uint32_t)l.kernel_width;
+		lh.kernel_height = (uint32_t)l.kernel_height;
+
+		const unsigned char *lhp = (const unsigned char *)&lh;
+		payload.insert(payload.end(), lhp, lhp + sizeof(lh));
+
+		const unsigned char *wp = (const unsigned char *)l.weight;
+		payload.insert(payload.end(), wp, wp + GetWeightNum(lh) * sizeof(float));
+
+		const unsigned char *bp = (const unsigned char *)l.bias;
+		payload.insert(payload.end(), bp, bp + lh.output_plane * sizeof(float));
+	}
+
+	boost::crc_32_type crc;
+	crc.process_bytes(payload.data(), payload.size());
+	header.checksum = crc.checksum();
+
+	boost::system::error_code error;
+
+	const boost::filesystem::path cache(cache_path);
+	boost::filesystem::create_directories(cache.parent_path(), error);
+
+	const boost::filesystem::path temp = cache.parent_path() / boost::filesystem::unique_path(cache.filename().string() + ".%%%%%%%%.tmp", error);
+	if (error)
+		return false;
+
+	FILE *fp = fopen(temp.string().c_str(), "wb");
+	if (!fp)
+		return false;
+
+	const bool isWritten = fwrite(&header, sizeof(header), 1, fp) == 1 && fwrite(payload.data(), 1, payload.size(), fp) == payload.size();
+	const bool isClosed = fclose(fp) == 0;
+
+	if (!isWritten || !isClosed)
+	{
+		boost::filesystem::remove(temp, error);
+		return false;
+	}
+
+	// ̃vZXɏłĂAǂ炩̊Sȃt@Cc
+	boost::filesystem::rename(temp, cache, error);
+	if (error)
+	{
+		boost::filesystem::remove(temp, error);
+		return false;
+	}
+
+	return true;
+}
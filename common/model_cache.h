@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+
+// fJSONod݂̂܂ܕׂoCit@C(LbV)̓ǂݏs
+// LbV̓}bvēǂݍނ̂ŁAJSON̉͂l̕ϊs킸ɏd݂g
+// LbVɂ͌`̃o[WAJSON̑傫ƍXVAd݂̃`FbNTL^ĂAvȂΎgȂ
+class Waifu2xModelCache
+{
+public:
+	struct stLayer
+	{
+		int input_plane;
+		int output_plane;
+		int kernel_width;
+		int kernel_height;
+		// o̓`l x ̓`l x kernel_height x kernel_width
+		const float *weight;
+		// o̓`l
+		const float *bias;
+	};
+
+private:
+	struct stMapping;
+
+	boost::shared_ptr<stMapping> mapping;
+	std::vector<stLayer> layer_list;
+
+public:
+	Waifu2xModelCache();
+	~Waifu2xModelCache();
+
+	// source_path(fJSON)̃LbVcache_dirɒũpX
+	// ʂ̃tH_ɂ铯ÕfƋʂł悤ɁAJSON̐΃pXlt@Cɕt
+	static std::string GetCachePath(const std::string &cache_dir, const std::string &source_path);
+
+	// cache_path̃LbVǂݍ
+	// LbVAĂ邩Asource_path̑傫XVL^ƈႤfalseԂ
+	bool Load(const std::string &cache_path, const std::string &source_path);
+
+	// Load()œǂݍ񂾊ew̏d(̃CX^Xj邩Load()܂ŗL)
+	const std::vector<stLayer>& layers() const;
+
+	// layerssource_path̃LbVƂcache_pathɏ
+	// ꎞt@Cɏł疼Oς̂ŁAݒ̃LbVʂ̃vZXǂނƂ͂Ȃ
+	static bool Write(const std::string &cache_path, const std::string &source_path, const std::vector<stLayer> &layers);
+};
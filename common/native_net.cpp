@@ -0,0 +1,654 @@
+#include "native_net.h"
+#include "pixel_kernel.h"
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <limits>
+#include <mutex>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define NATIVE_NET_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#ifdef NATIVE_NET_X86
+// AVX-512̃CgVbNVisual Studio 2017ȍ~łȂƎgȂ
+#if !defined(_MSC_VER) || _MSC_VER >= 1910
+#define NATIVE_NET_AVX512
+#endif
+#endif
+
+#ifdef _MSC_VER
+#define NN_TARGET_AVX2
+#define NN_TARGET_AVX512
+#else
+#define NN_TARGET_AVX2 __attribute__((target("avx2,fma,f16c")))
+#define NN_TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+
+
+namespace
+{
+	// ď݂^(float, uint16_t(x_), int8_t)̏ݍ
+	// scaleint8_t̎̏o̓`l̃XP[BȊO̎nullptr
+	template <typename W>
+	struct ConvLayerFuncType
+	{
+		typedef void(*Func)(const float *in, const int in_width, const int in_height, const int ic, const W *weight, const float *scale, const float *bias, const int oc,
+			const bool is_vectorize_output, const bool is_relu, const float negative_slope, float *out);
+	};
+
+	typedef ConvLayerFuncType<float>::Func ConvLayerFunc;
+	typedef ConvLayerFuncType<uint16_t>::Func ConvLayerHalfFunc;
+	typedef ConvLayerFuncType<int8_t>::Func ConvLayerInt8Func;
+
+	// x_̔zfloat̔z̕ϊ
+	typedef void(*ConvertFromHalfFunc)(const uint16_t *src, const size_t num, float *dst);
+	typedef void(*ConvertToHalfFunc)(const float *src, const size_t num, uint16_t *dst);
+
+	// o̓`l̐̔{̑w͏o̓`lɃxNg(SĂ̖߃ZbgVL * OB̔{)
+	const int VectorizeOutputChannelUnit = 32;
+
+	// F16C߂ƓʂɂȂ(ŋߐڋۂ߂)float甼x_ւ̕ϊ
+	uint16_t FloatToHalf(const float f)
+	{
+		uint32_t x;
+		memcpy(&x, &f, sizeof(x));
+
+		const uint32_t sign = (x >> 16) & 0x8000;
+		x &= 0x7fffffff;
+
+		// NaN
+		if (x >= 0x7f800000)
+			return (uint16_t)(sign | 0x7c00 | (x > 0x7f800000 ? 0x200 | ((x >> 13) & 0x3ff) : 0));
+
+		// 65520ȏ͊ۂ߂ƖɂȂ
+		if (x >= 0x477ff000)
+			return (uint16_t)(sign | 0x7c00);
+
+		// x̐K͈̔(2^-14ȏ)
+		if (x >= 0x38800000)
+		{
+			uint32_t h = (x - 0x38000000) >> 13;
+			const uint32_t rem = x & 0x1fff;
+			if (rem > 0x1000 || (rem == 0x1000 && (h & 1)))
+				h++;
+
+			return (uint16_t)(sign | h);
+		}
+
+		// 2^-25ȉ0ɂȂ
+		if (x <= 0x33000000)
+			return (uint16_t)sign;
+
+		// x̔񐳋K
+		const int shift = 126 - (int)(x >> 23);
+		const uint32_t m = (x & 0x7fffff) | 0x800000;
+		const uint32_t rem = m & ((1u << shift) - 1);
+		const uint32_t half = 1u << (shift - 1);
+
+		uint32_t h = m >> shift;
+		if (rem > half || (rem == half && (h & 1)))
+			h++;
+
+		return (uint16_t)(sign | h);
+	}
+
+	// F16C߂ƓʂɂȂ锼x_floatւ̕ϊ
+	float HalfToFloat(const uint16_t h)
+	{
+		const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+		const uint32_t e = (h >> 10) & 0x1f;
+		uint32_t m = h & 0x3ff;
+
+		uint32_t x;
+		if (e == 0x1f)
+			x = sign | 0x7f800000 | (m << 13) | (m ? 0x400000 : 0);
+		else if (e != 0)
+			x = sign | ((e + 112) << 23) | (m << 13);
+		else if (m == 0)
+			x = sign;
+		else
+		{
+			// 񐳋K͐K
+			int shift = 0;
+			while (!(m & 0x400))
+			{
+				m <<= 1;
+				shift++;
+			}
+
+			x = sign | ((uint32_t)(113 - shift) << 23) | ((m & 0x3ff) << 13);
+		}
+
+		float f;
+		memcpy(&f, &x, sizeof(f));
+
+		return f;
+	}
+
+	// d݂̗vffloatɂ(xNgłȂ[̕)
+	inline float WeightToFloat(const float w) { return w; }
+	inline float WeightToFloat(const uint16_t w) { return HalfToFloat(w); }
+	inline float WeightToFloat(const int8_t w) { return (float)w; }
+
+	namespace NativeKernelScalar
+	{
+		typedef float Vec;
+		const int VL = 1;
+		const int XB = 4;
+		const int OB = 8;
+
+		static inline Vec Load(const float *p) { return *p; }
+		static inline void Store(float *p, const Vec v) { *p = v; }
+		static inline Vec Set1(const float x) { return x; }
+		static inline Vec Zero() { return 0.0f; }
+		static inline Vec Fma(const Vec a, const Vec b, const Vec c) { return a * b + c; }
+		static inline Vec Add(const Vec a, const Vec b) { return a + b; }
+		static inline Vec Mul(const Vec a, const Vec b) { return a * b; }
+		static inline Vec Max(const Vec a, const Vec b) { return std::max(a, b); }
+		static inline Vec Min(const Vec a, const Vec b) { return std::min(a, b); }
+		static inline float HSum(const Vec v) { return v; }
+		static inline Vec LoadHalf(const uint16_t *p) { return HalfToFloat(*p); }
+		static inline void StoreHalf(uint16_t *p, const Vec v) { *p = FloatToHalf(v); }
+		static inline Vec LoadInt8(const int8_t *p) { return (float)*p; }
+
+#define NN_TARGET
+#include "native_net_kernel.inl"
+#undef NN_TARGET
+	}
+
+#ifdef NATIVE_NET_X86
+	namespace NativeKernelAVX2
+	{
+		typedef __m256 Vec;
+		const int VL = 8;
+		const int XB = 6;
+		const int OB = 2;
+
+		NN_TARGET_AVX2 static inline Vec Load(const float *p) { return _mm256_loadu_ps(p); }
+		NN_TARGET_AVX2 static inline void Store(float *p, const Vec v) { _mm256_storeu_ps(p, v); }
+		NN_TARGET_AVX2 static inline Vec Set1(const float x) { return _mm256_set1_ps(x); }
+		NN_TARGET_AVX2 static inline Vec Zero() { return _mm256_setzero_ps(); }
+		NN_TARGET_AVX2 static inline Vec Fma(const Vec a, const Vec b, const Vec c) { return _mm256_fmadd_ps(a, b, c); }
+		NN_TARGET_AVX2 static inline Vec Add(const Vec a, const Vec b) { return _mm256_add_ps(a, b); }
+		NN_TARGET_AVX2 static inline Vec Mul(const Vec a, const Vec b) { return _mm256_mul_ps(a, b); }
+		NN_TARGET_AVX2 static inline Vec Max(const Vec a, const Vec b) { return _mm256_max_ps(a, b); }
+		NN_TARGET_AVX2 static inline Vec Min(const Vec a, const Vec b) { return _mm256_min_ps(a, b); }
+		NN_TARGET_AVX2 static inline float HSum(const Vec v)
+		{
+			__m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+			s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+			s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+			return _mm_cvtss_f32(s);
+		}
+		NN_TARGET_AVX2 static inline Vec LoadHalf(const uint16_t *p) { return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)p)); }
+		NN_TARGET_AVX2 static inline void StoreHalf(uint16_t *p, const Vec v) { _mm_storeu_si128((__m128i *)p, _mm256_cvtps_ph(v, 0)); }
+		NN_TARGET_AVX2 static inline Vec LoadInt8(const int8_t *p) { return _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)p))); }
+
+#define NN_TARGET NN_TARGET_AVX2
+#include "native_net_kernel.inl"
+#undef NN_TARGET
+	}
+#endif
+
+#ifdef NATIVE_NET_AVX512
+	namespace NativeKernelAVX512
+	{
+		typedef __m512 Vec;
+		const int VL = 16;
+		const int XB = 8;
+		const int OB = 2;
+
+		NN_TARGET_AVX512 static inline Vec Load(const float *p) { return _mm512_loadu_ps(p); }
+		NN_TARGET_AVX512 static inline void Store(float *p, const Vec v) { _mm512_storeu_ps(p, v); }
+		NN_TARGET_AVX512 static inline Vec Set1(const float x) { return _mm512_set1_ps(x); }
+		NN_TARGET_AVX512 static inline Vec Zero() { return _mm512_setzero_ps(); }
+		NN_TARGET_AVX512 static inline Vec Fma(const Vec a, const Vec b, const Vec c) { return _mm512_fmadd_ps(a, b, c); }
+		NN_TARGET_AVX512 static inline Vec Add(const Vec a, const Vec b) { return _mm512_add_ps(a, b); }
+		NN_TARGET_AVX512 static inline Vec Mul(const Vec a, const Vec b) { return _mm512_mul_ps(a, b); }
+		NN_TARGET_AVX512 static inline Vec Max(const Vec a, const Vec b) { return _mm512_max_ps(a, b); }
+		NN_TARGET_AVX512 static inline Vec Min(const Vec a, const Vec b) { return _mm512_min_ps(a, b); }
+		NN_TARGET_AVX512 static inline float HSum(const Vec v)
+		{
+			float tmp[16];
+			_mm512_storeu_ps(tmp, v);
+
+			float s = 0.0f;
+			for (int i = 0; i < 16; i++)
+				s += tmp[i];
+
+			return s;
+		}
+		NN_TARGET_AVX512 static inline Vec LoadHalf(const uint16_t *p) { return _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)p)); }
+		NN_TARGET_AVX512 static inline void StoreHalf(uint16_t *p, const Vec v) { _mm256_storeu_si256((__m256i *)p, _mm512_cvtps_ph(v, 0)); }
+		NN_TARGET_AVX512 static inline Vec LoadInt8(const int8_t *p) { return _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(_mm_loadu_si128((const __m128i *)p))); }
+
+#define NN_TARGET NN_TARGET_AVX512
+#include "native_net_kernel.inl"
+#undef NN_TARGET
+	}
+#endif
+
+	enum eISA
+	{
+		eISA_Scalar,
+		eISA_AVX2,
+		eISA_AVX512,
+	};
+
+	std::once_flag isa_once_flag;
+	eISA isa = eISA_Scalar;
+	ConvLayerFunc conv_layer_func = nullptr;
+	ConvLayerHalfFunc conv_layer_half_func = nullptr;
+	ConvLayerInt8Func conv_layer_int8_func = nullptr;
+	ConvertFromHalfFunc convert_from_half_func = nullptr;
+	ConvertToHalfFunc convert_to_half_func = nullptr;
+
+	// CPUOSΉĂ閽߃Zbg𒲂ׂ
+	eISA DetectISA()
+	{
+#ifdef NATIVE_NET_X86
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		const int max_id = info[0];
+		if (max_id < 7)
+			return eISA_Scalar;
+
+		__cpuid(info, 1);
+		const bool isOSXSAVE = (info[2] & (1 << 27)) != 0;
+		const bool isAVX = (info[2] & (1 << 28)) != 0;
+		const bool isFMA = (info[2] & (1 << 12)) != 0;
+		const bool isF16C = (info[2] & (1 << 29)) != 0;
+		if (!isOSXSAVE || !isAVX || !isFMA || !isF16C)
+			return eISA_Scalar;
+
+		// OSYMM(ZMM)WX^ۑ邩
+		const unsigned long long xcr0 = _xgetbv(0);
+		if ((xcr0 & 0x6) != 0x6)
+			return eISA_Scalar;
+
+		__cpuidex(info, 7, 0);
+		const bool isAVX2 = (info[1] & (1 << 5)) != 0;
+		const bool isAVX512F = (info[1] & (1 << 16)) != 0;
+
+#ifdef NATIVE_NET_AVX512
+		if (isAVX512F && (xcr0 & 0xe6) == 0xe6)
+			return eISA_AVX512;
+#endif
+		if (isAVX2)
+			return eISA_AVX2;
+#else
+		__builtin_cpu_init();
+
+#ifdef NATIVE_NET_AVX512
+		if (__builtin_cpu_supports("avx512f"))
+			return eISA_AVX512;
+#endif
+		if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c"))
+			return eISA_AVX2;
+#endif
+#endif
+
+		return eISA_Scalar;
+	}
+
+	void InitISA()
+	{
+		std::call_once(isa_once_flag, []()
+		{
+			isa = DetectISA();
+
+			switch (isa)
+			{
+#ifdef NATIVE_NET_AVX512
+			case eISA_AVX512:
+				conv_layer_func = NativeKernelAVX512::ConvLayer<float>;
+				conv_layer_half_func = NativeKernelAVX512::ConvLayer<uint16_t>;
+				conv_layer_int8_func = NativeKernelAVX512::ConvLayer<int8_t>;
+				convert_from_half_func = NativeKernelAVX512::ConvertFromHalf;
+				convert_to_half_func = NativeKernelAVX512::ConvertToHalf;
+				break;
+#endif
+#ifdef NATIVE_NET_X86
+			case eISA_AVX2:
+				conv_layer_func = NativeKernelAVX2::ConvLayer<float>;
+				conv_layer_half_func = NativeKernelAVX2::ConvLayer<uint16_t>;
+				conv_layer_int8_func = NativeKernelAVX2::ConvLayer<int8_t>;
+				convert_from_half_func = NativeKernelAVX2::ConvertFromHalf;
+				convert_to_half_func = NativeKernelAVX2::ConvertToHalf;
+				break;
+#endif
+			default:
+				isa = eISA_Scalar;
+				conv_layer_func = NativeKernelScalar::ConvLayer<float>;
+				conv_layer_half_func = NativeKernelScalar::ConvLayer<uint16_t>;
+				conv_layer_int8_func = NativeKernelScalar::ConvLayer<int8_t>;
+				convert_from_half_func = NativeKernelScalar::ConvertFromHalf;
+				convert_to_half_func = NativeKernelScalar::ConvertToHalf;
+				break;
+			}
+		});
+	}
+}
+
+
+Waifu2xNativeNet::Waifu2xNativeNet(const ePrecision precision) : precision(precision)
+{
+	InitISA();
+}
+
+bool Waifu2xNativeNet::AddLayer(const int input_channels, const int output_channels, const float *weight, const float *bias)
+{
+	if (input_channels <= 0 || output_channels <= 0)
+		return false;
+
+	if (layers.size() > 0 && layers.back().output_channels != input_channels)
+		return false;
+
+	stLayer l;
+	l.input_channels = input_channels;
+	l.output_channels = output_channels;
+	l.is_vectorize_output = output_channels % VectorizeOutputChannelUnit == 0;
+	l.is_relu = false;
+	l.negative_slope = 0.0f;
+
+	l.bias.assign(bias, bias + output_channels);
+
+	const int WeightNum = output_channels * input_channels * 9;
+
+	switch (precision)
+	{
+	case ePrecision_FP16:
+		l.half_weight.resize(WeightNum);
+		break;
+
+	case ePrecision_INT8:
+		l.int8_weight.resize(WeightNum);
+
+		// o̓`lɁAΒlő̏d݂127ɂȂXP[ɂ
+		l.scale.resize(output_channels);
+		for (int o = 0; o < output_channels; o++)
+		{
+			float max_abs = 0.0f;
+			for (int i = 0; i < input_channels * 9; i++)
+				max_abs = std::max(max_abs, fabsf(weight[o * input_channels * 9 + i]));
+
+			l.scale[o] = max_abs > 0.0f ? max_abs / 127.0f : 1.0f;
+		}
+		break;
+
+	default:
+		l.weight.resize(WeightNum);
+		break;
+	}
+
+	for (int o = 0; o < output_channels; o++)
+	{
+		for (int c = 0; c < input_channels; c++)
+		{
+			for (int k = 0; k < 9; k++)
+			{
+				const float w = weight[(o * input_channels + c) * 9 + k];
+
+				int index;
+				if (l.is_vectorize_output)
+					index = (k * input_channels + c) * output_channels + o;
+				else
+					index = (o * 9 + k) * input_channels + c;
+
+				switch (precision)
+				{
+				case ePrecision_FP16:
+					l.half_weight[index] = FloatToHalf(w);
+					break;
+
+				case ePrecision_INT8:
+					l.int8_weight[index] = (int8_t)std::min(std::max((int)floorf(w / l.scale[o] + 0.5f), -127), 127);
+					break;
+
+				default:
+					l.weight[index] = w;
+					break;
+				}
+			}
+		}
+	}
+
+	layers.push_back(l);
+
+	return true;
+}
+
+bool Waifu2xNativeNet::SetReLU(const float negative_slope)
+{
+	if (layers.size() == 0)
+		return false;
+
+	layers.back().is_relu = true;
+	layers.back().negative_slope = negative_slope;
+
+	return true;
+}
+
+int Waifu2xNativeNet::layer_num() const
+{
+	return (int)layers.size();
+}
+
+int Waifu2xNativeNet::input_channels() const
+{
+	return layers.size() > 0 ? layers.front().input_channels : 0;
+}
+
+int Waifu2xNativeNet::output_channels() const
+{
+	return layers.size() > 0 ? layers.back().output_channels : 0;
+}
+
+Waifu2xNativeNet::ePrecision Waifu2xNativeNet::GetPrecision() const
+{
+	return precision;
+}
+
+void Waifu2xNativeNet::Forward(const float *input, const int width, const int height, float *output, std::vector<float> &work, std::vector<uint16_t> &half_work) const
+{
+	if (precision != ePrecision_FP32)
+	{
+		ForwardReduced(input, width, height, output, work, half_work);
+		return;
+	}
+
+	int max_channels = 0;
+	for (const auto &l : layers)
+		max_channels = std::max(max_channels, std::max(l.input_channels, l.output_channels));
+
+	// ew̓o(HWC)݂ɒu
+	const size_t buffer_size = (size_t)width * height * max_channels;
+	if (work.size() < buffer_size * 2)
+		work.resize(buffer_size * 2);
+
+	float *src = work.data();
+	float *dst = work.data() + buffer_size;
+
+	// `lɕ񂾓͂fɕג
+	{
+		const int ic = input_channels();
+		const int plane = width * height;
+
+		std::vector<const float *> planes(ic);
+		for (int c = 0; c < ic; c++)
+			planes[c] = input + c * plane;
+
+		Waifu2xPixelKernel::Interleave(planes.data(), plane, ic, src);
+	}
+
+	int w = width;
+	int h = height;
+	for (const auto &l : layers)
+	{
+		conv_layer_func(src, w, h, l.input_channels, l.weight.data(), nullptr, l.bias.data(), l.output_channels,
+			l.is_vectorize_output, l.is_relu, l.negative_slope, dst);
+
+		std::swap(src, dst);
+		w -= 2;
+		h -= 2;
+	}
+
+	// ʂ`lɕגďo͂
+	{
+		const int oc = output_channels();
+		const int plane = w * h;
+
+		std::vector<float *> planes(oc);
+		for (int c = 0; c < oc; c++)
+			planes[c] = output + c * plane;
+
+		Waifu2xPixelKernel::Deinterleave(src, plane, oc, planes.data());
+	}
+}
+
+// FP16INT8̎Forward()
+// ẘԂ̉摜͔x_ŎAo1sɕKvȓ3sfloatɖ߂ďݍ݁Aʂ1s𔼐x_ɂď
+// ŏ̑w̓͂ƍŌ̑w̏o͂float̂܂܈
+void Waifu2xNativeNet::ForwardReduced(const float *input, const int width, const int height, float *output, std::vector<float> &work, std::vector<uint16_t> &half_work) const
+{
+	int max_channels = 0;
+	for (const auto &l : layers)
+		max_channels = std::max(max_channels, std::max(l.input_channels, l.output_channels));
+
+	const int ic = input_channels();
+	const int oc = output_channels();
+	const int Plane = width * height;
+	const int OutWidth = width - layer_num() * 2;
+	const int OutHeight = height - layer_num() * 2;
+	const size_t Line = (size_t)width * max_channels;
+
+	// float̍Ɨpobt@ɂ́A͉摜(HWC)Afloatɖ߂3sAo1sAo͉摜(HWC)u
+	const size_t FloatSize = (size_t)Plane * ic + Line * 3 + Line + (size_t)OutWidth * OutHeight * oc;
+	if (work.size() < FloatSize)
+		work.resize(FloatSize);
+
+	// ew̓o(HWC)݂ɒu
+	const size_t HalfBufferSize = (size_t)Plane * max_channels;
+	if (half_work.size() < HalfBufferSize * 2)
+		half_work.resize(HalfBufferSize * 2);
+
+	float *in_image = work.data();
+	float *in_rows = in_image + (size_t)Plane * ic;
+	float *out_row = in_rows + Line * 3;
+	float *out_image = out_row + Line;
+
+	uint16_t *src = half_work.data();
+	uint16_t *dst = half_work.data() + HalfBufferSize;
+
+	// `lɕ񂾓͂fɕג
+	{
+		std::vector<const float *> planes(ic);
+		for (int c = 0; c < ic; c++)
+			planes[c] = input + c * Plane;
+
+		Waifu2xPixelKernel::Interleave(planes.data(), Plane, ic, in_image);
+	}
+
+	int w = width;
+	int h = height;
+	for (size_t i = 0; i < layers.size(); i++)
+	{
+		const stLayer &l = layers[i];
+		const bool isFirst = i == 0;
+		const bool isLast = i + 1 == layers.size();
+
+		const int in_line = w * l.input_channels;
+		const int out_line = (w - 2) * l.output_channels;
+
+		for (int y = 0; y < h - 2; y++)
+		{
+			const float *in = in_image + (size_t)y * in_line;
+			if (!isFirst)
+			{
+				convert_from_half_func(src + (size_t)y * in_line, (size_t)in_line * 3, in_rows);
+				in = in_rows;
+			}
+
+			float *out = isLast ? out_image + (size_t)y * out_line : out_row;
+
+			if (precision == ePrecision_INT8)
+			{
+				conv_layer_int8_func(in, w, 3, l.input_channels, l.int8_weight.data(), l.scale.data(), l.bias.data(), l.output_channels,
+					l.is_vectorize_output, l.is_relu, l.negative_slope, out);
+			}
+			else
+			{
+				conv_layer_half_func(in, w, 3, l.input_channels, l.half_weight.data(), nullptr, l.bias.data(), l.output_channels,
+					l.is_vectorize_output, l.is_relu, l.negative_slope, out);
+			}
+
+			if (!isLast)
+				convert_to_half_func(out, out_line, dst + (size_t)y * out_line);
+		}
+
+		std::swap(src, dst);
+		w -= 2;
+		h -= 2;
+	}
+
+	// ʂ`lɕגďo͂
+	{
+		const int plane = w * h;
+
+		std::vector<float *> planes(oc);
+		for (int c = 0; c < oc; c++)
+			planes[c] = output + c * plane;
+
+		Waifu2xPixelKernel::Deinterleave(out_image, plane, oc, planes.data());
+	}
+}
+
+const char* Waifu2xNativeNet::GetISAName()
+{
+	InitISA();
+
+	switch (isa)
+	{
+	case eISA_AVX512:
+		return "avx512";
+	case eISA_AVX2:
+		return "avx2";
+	default:
+		return "scalar";
+	}
+}
+
+bool Waifu2xNativeNet::ParsePrecision(const std::string &name, ePrecision &precision)
+{
+	if (name == "fp32")
+		precision = ePrecision_FP32;
+	else if (name == "fp16")
+		precision = ePrecision_FP16;
+	else if (name == "int8")
+		precision = ePrecision_INT8;
+	else
+		return false;
+
+	return true;
+}
+
+double Waifu2xNativeNet::PSNR(const float *a, const float *b, const size_t num)
+{
+	double sum = 0.0;
+	for (size_t i = 0; i < num; i++)
+	{
+		const double d = (double)a[i] - b[i];
+		sum += d * d;
+	}
+
+	if (num == 0 || sum == 0.0)
+		return std::numeric_limits<double>::infinity();
+
+	return 10.0 * log10(1.0 / (sum / num));
+}
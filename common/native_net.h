@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+// srcnn.prototxt̃lbg[N(3x3̏ݍ݂leaky ReLȖgݍ킹)CaffeʂCPUŌvZ
+// im2col̍Ɨpobt@炸ɒڏݍ݂sAoCAXƊ֐ݍ݂ƓɓKp
+// d݂͍\zɕύXȂ̂ŁA̃CX^X𕡐̃Xbh瓯ɎgĂ悢
+class Waifu2xNativeNet
+{
+public:
+	// vZ̐xBǂϘafloatŌvZ
+	enum ePrecision
+	{
+		ePrecision_FP32,	// d݂ẘԂ̉摜float
+		ePrecision_FP16,	// d݂ƑẘԂ̉摜𔼐x_Ŏ
+		ePrecision_INT8,	// d݂o̓`l̃XP[8bitɗʎqAẘԂ̉摜͔x_Ŏ
+	};
+
+private:
+	struct stLayer
+	{
+		int input_channels;
+		int output_channels;
+		// o̓`lɃxNg鎞[ky][kx][̓`l][o̓`l]A
+		// łȂ(o̓`lȂŏIw)[o̓`l][ky][kx][̓`l]̏ɕבւd
+		// precisionɉweight(FP32), half_weight(FP16), int8_weight(INT8)̂ǂꂩ
+		std::vector<float> weight;
+		std::vector<uint16_t> half_weight;
+		std::vector<int8_t> int8_weight;
+		// INT8̎̏o̓`l̃XP[(d = int8_weight * scale)
+		std::vector<float> scale;
+		std::vector<float> bias;
+		bool is_vectorize_output;
+		bool is_relu;
+		float negative_slope;
+	};
+
+	ePrecision precision;
+	std::vector<stLayer> layers;
+
+	void ForwardReduced(const float *input, const int width, const int height, float *output, std::vector<float> &work, std::vector<uint16_t> &half_work) const;
+
+public:
+	Waifu2xNativeNet(const ePrecision precision = ePrecision_FP32);
+
+	// Caffȅݍݑw̏d(o̓`l x ̓`l x 3 x 3)ƃoCAXŌ̑wƂĒǉ
+	bool AddLayer(const int input_channels, const int output_channels, const float *weight, const float *bias);
+	// Ōɒǉw̏o͂leaky ReLUKp
+	bool SetReLU(const float negative_slope);
+
+	int layer_num() const;
+	int input_channels() const;
+	int output_channels() const;
+
+	// input: input_channels() x height x width̉摜(`lɕׂ)
+	// output: output_channels() x (height - layer_num() * 2) x (width - layer_num() * 2)̉摜
+	// work, half_work: Ɨpobt@BĂяoXbhɗpӂĎg(half_workFP32ȊO̎g)
+	void Forward(const float *input, const int width, const int height, float *output, std::vector<float> &work, std::vector<uint16_t> &half_work) const;
+
+	ePrecision GetPrecision() const;
+
+	// sɑI΂ꂽ߃Zbg̖O(avx512, avx2, scalar)
+	static const char* GetISAName();
+
+	// O(fp32, fp16, int8)琸x𓾂BmȂOȂfalse
+	static bool ParsePrecision(const std::string &name, ePrecision &precision);
+
+	// 傫̉摜a, b(l0.0f`1.0f)PSNR(dB)BvĂΖ
+	static double PSNR(const float *a, const float *b, const size_t num);
+};
@@ -0,0 +1,184 @@
+// Waifu2xNativeNet̏ݍ݃J[l
+// native_net.cppŖ߃Zbg̖OԂ̒CN[h
+// CN[hOɈȉ`Ă
+//  Vec: xNg^, VL: xNg̗vf, XB: xɌvZf, OB: xɌvZxNg(o̓`l)
+//  Load, Store, Set1, Zero, Fma, Add, Mul, Max, Min, HSum: xNgZ
+//  LoadHalf, StoreHalf, LoadInt8: x_A8bitVLvfVec̕ϊ
+//  NN_TARGET: ֐ɕt閽߃Zbg̎w
+// ď݂^Wfloat, uint16_t(x_), int8_t(o̓`l̃XP[|Ďg)̂ǂꂩ
+
+// leaky ReLUBCaffeƓmax(x, 0) + negative_slope * min(x, 0)ŌvZ
+NN_TARGET static inline Vec Activate(const Vec v, const Vec slope)
+{
+	const Vec zero = Zero();
+	return Fma(slope, Min(v, zero), Max(v, zero));
+}
+
+NN_TARGET static inline Vec LoadWeight(const float *p) { return Load(p); }
+NN_TARGET static inline Vec LoadWeight(const uint16_t *p) { return LoadHalf(p); }
+NN_TARGET static inline Vec LoadWeight(const int8_t *p) { return LoadInt8(p); }
+
+// XBf x (VL * OB)`l̏o͂vZ(o̓`lɃxNg)
+// in: ͂̍̉f, in_line: 1s̗vf, out: o͂̉f(HWC)
+// scale΁Ad݂Ƃ̐Ϙascale|ĂoCAX𑫂
+template <int N, typename W>
+NN_TARGET static inline void ConvBlockVectorizeOutput(const float *in, const int in_line, const int ic, const W *weight, const float *scale, const float *bias, const int oc,
+	const int o, const bool is_relu, const Vec slope, float *out)
+{
+	Vec acc[N][OB];
+	for (int k = 0; k < OB; k++)
+	{
+		const Vec b = scale ? Zero() : Load(bias + o + k * VL);
+		for (int p = 0; p < N; p++)
+			acc[p][k] = b;
+	}
+
+	for (int ky = 0; ky < 3; ky++)
+	{
+		for (int kx = 0; kx < 3; kx++)
+		{
+			const float *ip = in + ky * in_line + kx * ic;
+			const W *wp = weight + (ky * 3 + kx) * ic * oc + o;
+
+			for (int c = 0; c < ic; c++, wp += oc)
+			{
+				Vec w[OB];
+				for (int k = 0; k < OB; k++)
+					w[k] = LoadWeight(wp + k * VL);
+
+				for (int p = 0; p < N; p++)
+				{
+					const Vec x = Set1(ip[p * ic + c]);
+					for (int k = 0; k < OB; k++)
+						acc[p][k] = Fma(x, w[k], acc[p][k]);
+				}
+			}
+		}
+	}
+
+	if (scale)
+	{
+		for (int k = 0; k < OB; k++)
+		{
+			const Vec s = Load(scale + o + k * VL);
+			const Vec b = Load(bias + o + k * VL);
+			for (int p = 0; p < N; p++)
+				acc[p][k] = Fma(acc[p][k], s, b);
+		}
+	}
+
+	for (int p = 0; p < N; p++)
+	{
+		for (int k = 0; k < OB; k++)
+		{
+			Vec v = acc[p][k];
+			if (is_relu)
+				v = Activate(v, slope);
+
+			Store(out + p * oc + o + k * VL, v);
+		}
+	}
+}
+
+// 1f x 1`l̏o(oCAX𑫂O̐Ϙa + init)vZ(̓`lɃxNg)
+template <typename W>
+NN_TARGET static inline float ConvPixelDot(const float *in, const int in_line, const int ic, const W *weight, const float init)
+{
+	Vec acc = Zero();
+	float sum = init;
+
+	for (int ky = 0; ky < 3; ky++)
+	{
+		for (int kx = 0; kx < 3; kx++)
+		{
+			const float *ip = in + ky * in_line + kx * ic;
+			const W *wp = weight + (ky * 3 + kx) * ic;
+
+			int c = 0;
+			for (; c + VL <= ic; c += VL)
+				acc = Fma(Load(ip + c), LoadWeight(wp + c), acc);
+			for (; c < ic; c++)
+				sum += ip[c] * WeightToFloat(wp[c]);
+		}
+	}
+
+	return sum + HSum(acc);
+}
+
+// w̏ݍ݂vZ
+// in: in_width x in_height x ic̉摜(HWC), out: (in_width - 2) x (in_height - 2) x oc̉摜(HWC)
+// scale: Wint8_t̎̏o̓`l̃XP[(ȊOnullptr)
+template <typename W>
+NN_TARGET static void ConvLayer(const float *in, const int in_width, const int in_height, const int ic, const W *weight, const float *scale, const float *bias, const int oc,
+	const bool is_vectorize_output, const bool is_relu, const float negative_slope, float *out)
+{
+	const int out_width = in_width - 2;
+	const int out_height = in_height - 2;
+	const int in_line = in_width * ic;
+
+	if (is_vectorize_output)
+	{
+		const Vec slope = Set1(negative_slope);
+
+		for (int y = 0; y < out_height; y++)
+		{
+			const float *irow = in + y * in_line;
+			float *orow = out + y * out_width * oc;
+
+			// o̓`l̏d݂sŜŎg
+			for (int o = 0; o < oc; o += VL * OB)
+			{
+				int x = 0;
+				for (; x + XB <= out_width; x += XB)
+					ConvBlockVectorizeOutput<XB>(irow + x * ic, in_line, ic, weight, scale, bias, oc, o, is_relu, slope, orow + x * oc);
+				for (; x < out_width; x++)
+					ConvBlockVectorizeOutput<1>(irow + x * ic, in_line, ic, weight, scale, bias, oc, o, is_relu, slope, orow + x * oc);
+			}
+		}
+	}
+	else
+	{
+		for (int y = 0; y < out_height; y++)
+		{
+			const float *irow = in + y * in_line;
+			float *orow = out + y * out_width * oc;
+
+			for (int x = 0; x < out_width; x++)
+			{
+				for (int o = 0; o < oc; o++)
+				{
+					float v;
+					if (scale)
+						v = ConvPixelDot(irow + x * ic, in_line, ic, weight + o * 9 * ic, 0.0f) * scale[o] + bias[o];
+					else
+						v = ConvPixelDot(irow + x * ic, in_line, ic, weight + o * 9 * ic, bias[o]);
+
+					if (is_relu)
+						v = std::max(v, 0.0f) + negative_slope * std::min(v, 0.0f);
+
+					orow[x * oc + o] = v;
+				}
+			}
+		}
+	}
+}
+
+// x_numvffloatɂ
+NN_TARGET static void ConvertFromHalf(const uint16_t *src, const size_t num, float *dst)
+{
+	size_t i = 0;
+	for (; i + VL <= num; i += VL)
+		Store(dst + i, LoadHalf(src + i));
+	for (; i < num; i++)
+		dst[i] = HalfToFloat(src[i]);
+}
+
+// floatnumvf𔼐x_ɂ
+NN_TARGET static void ConvertToHalf(const float *src, const size_t num, uint16_t *dst)
+{
+	size_t i = 0;
+	for (; i + VL <= num; i += VL)
+		StoreHalf(dst + i, Load(src + i));
+	for (; i < num; i++)
+		dst[i] = FloatToHalf(src[i]);
+}
@@ -0,0 +1,234 @@
+#include "pixel_kernel.h"
+#include <mutex>
+#include <string.h>
+
+#if defined(_M_X64) || defined(__x86_64__)
+// x64ȂSSE2͕Kg
+#define PIXEL_KERNEL_SSE2
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#ifdef _MSC_VER
+#define PK_TARGET_SSSE3
+#else
+#define PK_TARGET_SSSE3 __attribute__((target("ssse3")))
+#endif
+
+
+namespace
+{
+	std::once_flag ssse3_once_flag;
+	bool isSSSE3 = false;
+
+	bool CanUseSSSE3()
+	{
+#ifdef PIXEL_KERNEL_SSE2
+		std::call_once(ssse3_once_flag, []()
+		{
+#ifdef _MSC_VER
+			int info[4];
+			__cpuid(info, 1);
+			isSSSE3 = (info[2] & (1 << 9)) != 0;
+#else
+			__builtin_cpu_init();
+			isSSSE3 = __builtin_cpu_supports("ssse3") != 0;
+#endif
+		});
+#endif
+
+		return isSSSE3;
+	}
+
+#ifdef PIXEL_KERNEL_SSE2
+	// ʂ[0], [1]a[i0], [i1]A[2], [3]b[i2], [i3]
+#define PK_SHUFFLE(a, b, i0, i1, i2, i3) _mm_shuffle_ps(a, b, _MM_SHUFFLE(i3, i2, i1, i0))
+
+	// 4f
+	inline void Deinterleave3x4(const float *src, float *d0, float *d1, float *d2)
+	{
+		// a = [c0 c1 c2 c0], b = [c1 c2 c0 c1], c = [c2 c0 c1 c2]
+		const __m128 a = _mm_loadu_ps(src);
+		const __m128 b = _mm_loadu_ps(src + 4);
+		const __m128 c = _mm_loadu_ps(src + 8);
+
+		const __m128 v0 = PK_SHUFFLE(a, PK_SHUFFLE(b, c, 2, 2, 1, 1), 0, 3, 0, 2);
+		const __m128 v1 = PK_SHUFFLE(PK_SHUFFLE(a, b, 1, 1, 0, 0), PK_SHUFFLE(b, c, 3, 3, 2, 2), 0, 2, 0, 2);
+		const __m128 v2 = PK_SHUFFLE(PK_SHUFFLE(a, b, 2, 2, 1, 1), c, 0, 2, 0, 3);
+
+		_mm_storeu_ps(d0, v0);
+		_mm_storeu_ps(d1, v1);
+		_mm_storeu_ps(d2, v2);
+	}
+
+	inline void Interleave3x4(const float *s0, const float *s1, const float *s2, float *dst)
+	{
+		const __m128 v0 = _mm_loadu_ps(s0);
+		const __m128 v1 = _mm_loadu_ps(s1);
+		const __m128 v2 = _mm_loadu_ps(s2);
+
+		const __m128 a = PK_SHUFFLE(PK_SHUFFLE(v0, v1, 0, 0, 0, 0), PK_SHUFFLE(v2, v0, 0, 0, 1, 1), 0, 2, 0, 2);
+		const __m128 b = PK_SHUFFLE(PK_SHUFFLE(v1, v2, 1, 1, 1, 1), PK_SHUFFLE(v0, v1, 2, 2, 2, 2), 0, 2, 0, 2);
+		const __m128 c = PK_SHUFFLE(PK_SHUFFLE(v2, v0, 2, 2, 3, 3), PK_SHUFFLE(v1, v2, 3, 3, 3, 3), 0, 2, 0, 2);
+
+		_mm_storeu_ps(dst, a);
+		_mm_storeu_ps(dst + 4, b);
+		_mm_storeu_ps(dst + 8, c);
+	}
+
+	inline void Deinterleave4x4(const float *src, float *d0, float *d1, float *d2, float *d3)
+	{
+		__m128 v0 = _mm_loadu_ps(src);
+		__m128 v1 = _mm_loadu_ps(src + 4);
+		__m128 v2 = _mm_loadu_ps(src + 8);
+		__m128 v3 = _mm_loadu_ps(src + 12);
+
+		_MM_TRANSPOSE4_PS(v0, v1, v2, v3);
+
+		_mm_storeu_ps(d0, v0);
+		_mm_storeu_ps(d1, v1);
+		_mm_storeu_ps(d2, v2);
+		_mm_storeu_ps(d3, v3);
+	}
+
+	inline void Interleave4x4(const float *s0, const float *s1, const float *s2, const float *s3, float *dst)
+	{
+		__m128 v0 = _mm_loadu_ps(s0);
+		__m128 v1 = _mm_loadu_ps(s1);
+		__m128 v2 = _mm_loadu_ps(s2);
+		__m128 v3 = _mm_loadu_ps(s3);
+
+		_MM_TRANSPOSE4_PS(v0, v1, v2, v3);
+
+		_mm_storeu_ps(dst, v0);
+		_mm_storeu_ps(dst + 4, v1);
+		_mm_storeu_ps(dst + 8, v2);
+		_mm_storeu_ps(dst + 12, v3);
+	}
+
+#undef PK_SHUFFLE
+
+	// fԂBc̓XJ[ŏ
+	PK_TARGET_SSSE3 int SwapRBSSSE3(const unsigned char *src, const int width, const int channels, unsigned char *dst)
+	{
+		int x = 0;
+
+		if (channels == 3)
+		{
+			// 16oCgǂݍ5f(15oCg)iށB16oCgڂ͂̂܂܂̒lނ̂ŁAsrc == dstł̓ǂݍ݂ɉeȂ
+			const __m128i mask = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+			for (; (x + 5) * 3 + 1 <= width * 3; x += 5)
+			{
+				const __m128i v = _mm_loadu_si128((const __m128i *)(src + x * 3));
+				_mm_storeu_si128((__m128i *)(dst + x * 3), _mm_shuffle_epi8(v, mask));
+			}
+		}
+		else if (channels == 4)
+		{
+			const __m128i mask = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+			for (; x + 4 <= width; x += 4)
+			{
+				const __m128i v = _mm_loadu_si128((const __m128i *)(src + x * 4));
+				_mm_storeu_si128((__m128i *)(dst + x * 4), _mm_shuffle_epi8(v, mask));
+			}
+		}
+
+		return x;
+	}
+#endif
+}
+
+
+void Waifu2xPixelKernel::Deinterleave(const float *src, const int width, const int channels, float *const *dst)
+{
+	int x = 0;
+
+#ifdef PIXEL_KERNEL_SSE2
+	if (channels == 3)
+	{
+		for (; x + 4 <= width; x += 4)
+			Deinterleave3x4(src + x * 3, dst[0] + x, dst[1] + x, dst[2] + x);
+	}
+	else if (channels == 4)
+	{
+		for (; x + 4 <= width; x += 4)
+			Deinterleave4x4(src + x * 4, dst[0] + x, dst[1] + x, dst[2] + x, dst[3] + x);
+	}
+#endif
+
+	if (channels == 1)
+	{
+		memcpy(dst[0], src, width * sizeof(float));
+		return;
+	}
+
+	for (; x < width; x++)
+	{
+		for (int ch = 0; ch < channels; ch++)
+			dst[ch][x] = src[x * channels + ch];
+	}
+}
+
+void Waifu2xPixelKernel::Interleave(const float *const *src, const int width, const int channels, float *dst)
+{
+	int x = 0;
+
+#ifdef PIXEL_KERNEL_SSE2
+	if (channels == 3)
+	{
+		for (; x + 4 <= width; x += 4)
+			Interleave3x4(src[0] + x, src[1] + x, src[2] + x, dst + x * 3);
+	}
+	else if (channels == 4)
+	{
+		for (; x + 4 <= width; x += 4)
+			Interleave4x4(src[0] + x, src[1] + x, src[2] + x, src[3] + x, dst + x * 4);
+	}
+#endif
+
+	if (channels == 1)
+	{
+		memcpy(dst, src[0], width * sizeof(float));
+		return;
+	}
+
+	for (; x < width; x++)
+	{
+		for (int ch = 0; ch < channels; ch++)
+			dst[x * channels + ch] = src[ch][x];
+	}
+}
+
+void Waifu2xPixelKernel::SwapRB(const unsigned char *src, const int width, const int channels, unsigned char *dst)
+{
+	if (channels != 3 && channels != 4)
+	{
+		if (src != dst)
+			memcpy(dst, src, width * channels);
+		return;
+	}
+
+	int x = 0;
+
+#ifdef PIXEL_KERNEL_SSE2
+	if (CanUseSSSE3())
+		x = SwapRBSSSE3(src, width, channels, dst);
+#endif
+
+	for (; x < width; x++)
+	{
+		const unsigned char *s = src + x * channels;
+		unsigned char *d = dst + x * channels;
+
+		const unsigned char c0 = s[0];
+		const unsigned char c2 = s[2];
+		d[0] = c2;
+		d[1] = s[1];
+		d[2] = c0;
+		if (channels == 4)
+			d[3] = s[3];
+	}
+}
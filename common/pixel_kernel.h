@@ -0,0 +1,21 @@
+#pragma once
+
+
+// f̕בւ(fɕ񂾉摜ƃ`lɕ񂾉摜̕ϊARB̓ւ)s
+// 3`l4`lSIMD߂ŏAȊÕ`l̓XJ[ŏ
+// v[i[̃|C^̏Ԃւ΃`l̏(RGBBGR)ɓւ
+class Waifu2xPixelKernel
+{
+public:
+	// src: widthf x channels̉fɕ1s
+	// dst: `l̏o͐(channels)Bdst[ch][x] = src[x * channels + ch]
+	static void Deinterleave(const float *src, const int width, const int channels, float *const *dst);
+
+	// src: `l̓͌(channels)
+	// dst: widthf x channels̉fɕ1sBdst[x * channels + ch] = src[ch][x]
+	static void Interleave(const float *const *src, const int width, const int channels, float *dst);
+
+	// widthf x channels(34)1sA0Ԗڂ2Ԗڂ̃`lւȂRs[(RGB(A)BGR(A)̕ϊ)
+	// channels34ȊO̎͂̂܂܃Rs[Bsrcdst͓ł悢
+	static void SwapRB(const unsigned char *src, const int width, const int channels, unsigned char *dst);
+};
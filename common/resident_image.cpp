@@ -0,0 +1,178 @@
+#include "resident_image.h"
+#include "pixel_kernel.h"
+#include <cuda_runtime.h>
+#include <vector>
+#include <string.h>
+
+
+Waifu2xResidentImage::Waifu2xResidentImage(const bool is_device) : is_device(is_device), channels(0), padding(0), input_width(0), input_height(0),
+	output_width(0), output_height(0), input_planes(nullptr), output_planes(nullptr)
+{
+}
+
+Waifu2xResidentImage::~Waifu2xResidentImage()
+{
+	Free(input_planes);
+	Free(output_planes);
+}
+
+bool Waifu2xResidentImage::Alloc(float **ptr, const size_t num)
+{
+	*ptr = nullptr;
+
+	if (is_device)
+		return cudaMalloc(ptr, sizeof(float) * num) == cudaSuccess;
+
+	try
+	{
+		*ptr = new float[num];
+	}
+	catch (...)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+void Waifu2xResidentImage::Free(float *&ptr)
+{
+	if (!ptr)
+		return;
+
+	if (is_device)
+		cudaFree(ptr);
+	else
+		delete[] ptr;
+
+	ptr = nullptr;
+}
+
+// ̃̊Ԃŋ`Rs[Bpitch͗vf
+bool Waifu2xResidentImage::Copy2D(float *dst, const int dst_pitch, const float *src, const int src_pitch, const int width, const int height) const
+{
+	if (is_device)
+	{
+		return cudaMemcpy2D(dst, sizeof(float) * dst_pitch, src, sizeof(float) * src_pitch, sizeof(float) * width, height,
+			cudaMemcpyDeviceToDevice) == cudaSuccess;
+	}
+
+	for (int i = 0; i < height; i++)
+		memcpy(dst + i * dst_pitch, src + i * src_pitch, sizeof(float) * width);
+
+	return true;
+}
+
+bool Waifu2xResidentImage::Upload(const cv::Mat &im, const int Padding, const cv::Size_<int> &output_size)
+{
+	Free(input_planes);
+	Free(output_planes);
+
+	channels = im.channels();
+	padding = Padding;
+	input_width = im.cols + padding * 2;
+	input_height = im.rows + padding * 2;
+	output_width = output_size.width;
+	output_height = output_size.height;
+
+	const size_t InputPlaneSize = (size_t)input_width * input_height;
+
+	if (!Alloc(&input_planes, InputPlaneSize * channels) || !Alloc(&output_planes, (size_t)output_width * output_height * channels))
+	{
+		Free(input_planes);
+		Free(output_planes);
+		return false;
+	}
+
+	cv::Mat border;
+	cv::copyMakeBorder(im, border, padding, padding, padding, padding, cv::BORDER_REPLICATE);
+
+	// GPU̎̓zXgŃ`lɕבւĂ܂Ƃ߂ē]
+	std::vector<float> buffer;
+	float *host_planes = input_planes;
+	if (is_device)
+	{
+		buffer.resize(InputPlaneSize * channels);
+		host_planes = buffer.data();
+	}
+
+	std::vector<float *> planes(channels);
+	for (int i = 0; i < input_height; i++)
+	{
+		for (int ch = 0; ch < channels; ch++)
+			planes[ch] = host_planes + ch * InputPlaneSize + (size_t)i * input_width;
+
+		Waifu2xPixelKernel::Deinterleave(border.ptr<float>(i), input_width, channels, planes.data());
+	}
+
+	if (is_device && cudaMemcpy(input_planes, buffer.data(), sizeof(float) * buffer.size(), cudaMemcpyHostToDevice) != cudaSuccess)
+		return false;
+
+	return true;
+}
+
+bool Waifu2xResidentImage::ExtractBlock(const int x, const int y, const int block_width, const int block_height, float *dst) const
+{
+	if (x < 0 || y < 0 || x + block_width > input_width || y + block_height > input_height)
+		return false;
+
+	const size_t InputPlaneSize = (size_t)input_width * input_height;
+
+	for (int ch = 0; ch < channels; ch++)
+	{
+		const float *src = input_planes + ch * InputPlaneSize + (size_t)y * input_width + x;
+		if (!Copy2D(dst + ch * block_width * block_height, block_width, src, input_width, block_width, block_height))
+			return false;
+	}
+
+	return true;
+}
+
+bool Waifu2xResidentImage::ScatterBlock(const float *src, const int src_width, const int src_height, const int src_offset, const int width, const int height,
+	const int x, const int y)
+{
+	if (x < 0 || y < 0 || x + width > output_width || y + height > output_height || src_offset + width > src_width || src_offset + height > src_height)
+		return false;
+
+	const size_t OutputPlaneSize = (size_t)output_width * output_height;
+
+	for (int ch = 0; ch < channels; ch++)
+	{
+		const float *sptr = src + ch * src_width * src_height + src_offset * src_width + src_offset;
+		float *dptr = output_planes + ch * OutputPlaneSize + (size_t)y * output_width + x;
+		if (!Copy2D(dptr, output_width, sptr, src_width, width, height))
+			return false;
+	}
+
+	return true;
+}
+
+bool Waifu2xResidentImage::Download(cv::Mat &im) const
+{
+	const size_t OutputPlaneSize = (size_t)output_width * output_height;
+
+	const float *host_planes = output_planes;
+
+	std::vector<float> buffer;
+	if (is_device)
+	{
+		buffer.resize(OutputPlaneSize * channels);
+		if (cudaMemcpy(buffer.data(), output_planes, sizeof(float) * buffer.size(), cudaMemcpyDeviceToHost) != cudaSuccess)
+			return false;
+
+		host_planes = buffer.data();
+	}
+
+	im.create(output_height, output_width, CV_MAKETYPE(CV_32F, channels));
+
+	std::vector<const float *> planes(channels);
+	for (int i = 0; i < output_height; i++)
+	{
+		for (int ch = 0; ch < channels; ch++)
+			planes[ch] = host_planes + ch * OutputPlaneSize + (size_t)i * output_width;
+
+		Waifu2xPixelKernel::Interleave(planes.data(), output_width, channels, im.ptr<float>(i));
+	}
+
+	return true;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+
+
+// lbg[Nɓ͂摜ŜApfBOă`lɕׂԂŃlbg[ŇvZɎgɒuA
+// ubN؂oălbg[N̓͂ɏ񂾂Albg[N̏o͂ʂ̉摜ɏ߂肷
+// is_devicetrueȂGPŨcudaMemcpy2DgāAfalseȂzXg̃memcpygēs
+// (falseGPU̖œ؂omF邽߂̂)
+class Waifu2xResidentImage
+{
+private:
+	bool is_device;
+
+	int channels;
+	int padding;
+	// pfBO͉摜̑傫
+	int input_width;
+	int input_height;
+	// ʂ̉摜̑傫
+	int output_width;
+	int output_height;
+
+	// ͉摜(input_width x input_height`lɕׂ)
+	float *input_planes;
+	// ʂ̉摜(output_width x output_height`lɕׂ)
+	float *output_planes;
+
+	bool Alloc(float **ptr, const size_t num);
+	void Free(float *&ptr);
+	bool Copy2D(float *dst, const int dst_pitch, const float *src, const int src_pitch, const int width, const int height) const;
+
+public:
+	Waifu2xResidentImage(const bool is_device);
+	~Waifu2xResidentImage();
+
+	// im(CV_32FC1CV_32FC3)̎͂padding[̉fŖ߂ē]Aoutput_sizȇ傫̌ʂ̉摜mۂ
+	// ȂfalseԂ
+	bool Upload(const cv::Mat &im, const int padding, const cv::Size_<int> &output_size);
+
+	// ̉摜ł(x - padding, y - padding)Ƃblock_width x block_heightdstɃ`lɕׂď
+	// dstis_devicetrueȂGPŨ
+	bool ExtractBlock(const int x, const int y, const int block_width, const int block_height, float *dst) const;
+
+	// src(src_width x src_height̉摜`lɕׂ)(src_offset, src_offset)Ƃwidth x heightAʂ̉摜(x, y)ɏ
+	// srcis_devicetrueȂGPŨ
+	bool ScatterBlock(const float *src, const int src_width, const int src_height, const int src_offset, const int width, const int height, const int x, const int y);
+
+	// ʂ̉摜fɕׂim(CV_32FC1CV_32FC3)Ɏo
+	bool Download(cv::Mat &im) const;
+};
@@ -1,4 +1,7 @@
 #include "waifu2x.h"
+#include "native_net.h"
+#include "pixel_kernel.h"
+#include "resident_image.h"
 #include <caffe/caffe.hpp>
 #include <cudnn.h>
 #include <mutex>
@@ -9,6 +12,11 @@
 #include <boost/algorithm/string.hpp>
 #include <chrono>
 #include <cuda_runtime.h>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <random>
+#include <limits>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
@@ -34,6 +42,14 @@
 const int offset = 0;
 // srcnn.prototxtŒ`ꂽC[̐
 const int layer_num = 7;
+// ubN̑傫̔{ɑ(lbg[Nɓ͂`̎ނ炵āA`̃ubNŃ~job`g݂₷)
+const int TileAlign = 8;
+// Ȃcrop_size鉺
+const int MinCropSize = TileAlign * 2;
+// Ȃɑтɕĕϊт̍s̉
+const int MinBandHeight = 16;
+// srcnn.prototxtŒ`ꂽew(Ō̑wȊO)̏o̓`l
+const int layer_output_planes[layer_num - 1] = { 32, 32, 64, 64, 128, 128 };
 
 const int ConvertMode = CV_RGB2YUV;
 const int ConvertInverseMode = CV_YUV2RGB;
@@ -89,9 +105,590 @@ namespace
 	};
 
 	IgnoreErrorCV g_IgnoreErrorCV;
+
+	// Ăj܂ł̎(b)timeɉZBtimenullptrȂ牽Ȃ
+	class StopWatch
+	{
+	private:
+		double *time;
+		std::chrono::high_resolution_clock::time_point start;
+
+	public:
+		StopWatch(double *Time) : time(Time), start(std::chrono::high_resolution_clock::now())
+		{
+		}
+
+		~StopWatch()
+		{
+			if (time)
+				*time += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		}
+	};
+
+	// im(x, y)Ƃblock_width x block_height͈̔͂A`lɕׂdstɏ
+	// valid(im͈̒̔)̊Ỏfvalid̒[̉fŖ߂(validŐ؂oĂcv::BORDER_REPLICATEŃpfBÔƓʂɂȂ)
+	void PackBlock(const cv::Mat &im, const int x, const int y, const cv::Rect &valid, const int block_width, const int block_height, float *dst)
+	{
+		const int Channel = im.channels();
+		const int Plane = block_width * block_height;
+
+		assert(Channel <= 4);
+
+		// E̗]̕B[0, left)͍[A[right, block_width)͉E[̉fŖ߂
+		const int left = std::min(std::max(valid.x - x, 0), block_width);
+		const int right = std::max(std::min(valid.x + valid.width - x, block_width), left);
+
+		const int first = valid.x;
+		const int last = valid.x + valid.width - 1;
+
+		float *dptrs[4];
+
+		for (int i = 0; i < block_height; i++)
+		{
+			const int sy = std::min(std::max(y + i, valid.y), valid.y + valid.height - 1);
+			const float *src = im.ptr<float>(sy);
+
+			for (int ch = 0; ch < Channel; ch++)
+			{
+				float *dptr = dst + ch * Plane + i * block_width;
+				dptrs[ch] = dptr + left;
+
+				const float first_value = src[first * Channel + ch];
+				const float last_value = src[last * Channel + ch];
+
+				for (int j = 0; j < left; j++)
+					dptr[j] = first_value;
+
+				for (int j = right; j < block_width; j++)
+					dptr[j] = last_value;
+			}
+
+			Waifu2xPixelKernel::Deinterleave(src + (x + left) * Channel, right - left, Channel, dptrs);
+		}
+	}
+
+	// imrect͈̔͂̉fA`l̍őlƍŏl̍toleranceȉȂtrueԂAvalueɍőlƍŏl̒Ԃ̒lԂ
+	// tolerance𒴂_őł؂̂ŁARłȂ͈͂͂ɏI
+	bool IsFlatRegion(const cv::Mat &im, const cv::Rect &rect, const float tolerance, cv::Scalar &value)
+	{
+		const int Channel = im.channels();
+
+		assert(Channel <= 4);
+
+		float min_value[4];
+		float max_value[4];
+
+		const float *first = im.ptr<float>(rect.y) + rect.x * Channel;
+		for (int ch = 0; ch < Channel; ch++)
+			min_value[ch] = max_value[ch] = first[ch];
+
+		for (int i = 0; i < rect.height; i++)
+		{
+			const float *src = im.ptr<float>(rect.y + i) + rect.x * Channel;
+
+			for (int j = 0; j < rect.width; j++)
+			{
+				for (int ch = 0; ch < Channel; ch++)
+				{
+					const float v = src[j * Channel + ch];
+
+					if (v < min_value[ch])
+						min_value[ch] = v;
+					else if (v > max_value[ch])
+						max_value[ch] = v;
+
+					if (max_value[ch] - min_value[ch] > tolerance)
+						return false;
+				}
+			}
+		}
+
+		value = cv::Scalar::all(0);
+		for (int ch = 0; ch < Channel; ch++)
+			value[ch] = (min_value[ch] + max_value[ch]) * 0.5;
+
+		return true;
+	}
+
+	// catch (...)̒ŌĂсA߂܂O̊mۂ̎s(std::bad_allocACV_StsNoMemAcudaErrorMemoryAllocation)Ȃ
+	// eWaifu2xError_OutOfMemoryAȊOȂotherԂ
+	Waifu2x::eWaifu2xError GetExceptionError(const Waifu2x::eWaifu2xError other)
+	{
+		try
+		{
+			throw;
+		}
+		catch (const std::bad_alloc &)
+		{
+			return Waifu2x::eWaifu2xError_OutOfMemory;
+		}
+		catch (const cv::Exception &e)
+		{
+			return e.code == CV_StsNoMem ? Waifu2x::eWaifu2xError_OutOfMemory : other;
+		}
+		catch (const cudaError_t e)
+		{
+			return e == cudaErrorMemoryAllocation ? Waifu2x::eWaifu2xError_OutOfMemory : other;
+		}
+		catch (...)
+		{
+			return other;
+		}
+	}
+
+	// ConvertModeAConvertInverseMode̐FϊAϊ̃`lc = m[c][0] * ch0 + m[c][1] * ch1 + m[c][2] * ch2 + m[c][3]̌`ŕ\
+	struct stColorMatrix
+	{
+		float forward[3][4];
+		float inverse[3][4];
+	};
+
+	// _̉摜̐Fϊ͈ꎟϊȂ̂ŁA1`l1.0̉fcv::cvtColor()ŕϊČW߂
+	// (cv::cvtColor()ƌW`l̏ԂKv)
+	void CreateColorMatrix(const int code, float m[3][4])
+	{
+		cv::Mat basis(1, 4, CV_32FC3, cv::Scalar::all(0));
+		for (int c = 0; c < 3; c++)
+			basis.ptr<float>(0)[(c + 1) * 3 + c] = 1.0f;
+
+		cv::Mat converted;
+		cv::cvtColor(basis, converted, code);
+
+		const float *p = converted.ptr<float>(0);
+		for (int r = 0; r < 3; r++)
+		{
+			for (int c = 0; c < 3; c++)
+				m[r][c] = p[(c + 1) * 3 + r] - p[r];
+			m[r][3] = p[r];
+		}
+	}
+
+	std::once_flag ColorMatrixOnceFlag;
+	stColorMatrix ColorMatrix;
+
+	const stColorMatrix& GetColorMatrix()
+	{
+		std::call_once(ColorMatrixOnceFlag, []()
+		{
+			CreateColorMatrix(ConvertMode, ColorMatrix.forward);
+			CreateColorMatrix(ConvertInverseMode, ColorMatrix.inverse);
+		});
+
+		return ColorMatrix;
+	}
+
+	// ͉摜1fAl0.0f`1.0f̃Zς݂BGRƃAt@ɂ
+	// CV_8U̓O[XP[ABGRABGRABConvertToFloatImage()Ɠϊ
+	inline void ReadPixel(const unsigned char *p, const int channels, float bgr[3], float &a)
+	{
+		const float s = 1.0f / 255.0f;
+
+		switch (channels)
+		{
+		case 1:
+			bgr[0] = bgr[1] = bgr[2] = p[0] * s;
+			a = 1.0f;
+			break;
+
+		case 3:
+			bgr[0] = p[0] * s;
+			bgr[1] = p[1] * s;
+			bgr[2] = p[2] * s;
+			a = 1.0f;
+			break;
+
+		default:
+			a = p[3] * s;
+			bgr[0] = p[0] * s * a;
+			bgr[1] = p[1] * s * a;
+			bgr[2] = p[2] * s * a;
+			break;
+		}
+	}
+
+	// CV_32FConvertToFloatImage()ŕϊς݂BGRABGRA
+	inline void ReadPixel(const float *p, const int channels, float bgr[3], float &a)
+	{
+		bgr[0] = p[0];
+		bgr[1] = p[1];
+		bgr[2] = p[2];
+		a = channels == 4 ? p[3] : 1.0f;
+	}
+
+	inline void WritePixel(const float v, float *dst)
+	{
+		*dst = v;
+	}
+
+	// convertTo(CV_8U, 255.0)Ɠۂ
+	inline void WritePixel(const float v, unsigned char *dst)
+	{
+		*dst = cv::saturate_cast<unsigned char>(v * 255.0f);
+	}
+
+	// ͉摜1sAlbg[Nɓ͂1s(plane1ȂPxA3ȂRGB)
+	template<typename T>
+	void CreateProcessRow(const T *src, const int width, const int channels, const int plane, const stColorMatrix &m, float *dst)
+	{
+		const float (&f)[4] = m.forward[0];
+
+		for (int x = 0; x < width; x++)
+		{
+			float bgr[3], a;
+			ReadPixel(src + x * channels, channels, bgr, a);
+
+			if (plane == 1)
+				dst[x] = f[0] * bgr[0] + f[1] * bgr[1] + f[2] * bgr[2] + f[3];
+			else
+			{
+				dst[x * 3 + 0] = bgr[2];
+				dst[x * 3 + 1] = bgr[1];
+				dst[x * 3 + 2] = bgr[0];
+			}
+		}
+	}
+
+	// ͉摜1sAgO̐F(is_chromaȂFϊ1A2Ԗڂ̃`l)ƃAt@(is_alphaȂ)fɕׂ1s
+	template<typename T>
+	void CreateColorRow(const T *src, const int width, const int channels, const bool is_chroma, const bool is_alpha, const stColorMatrix &m, float *dst)
+	{
+		const int Channel = (is_chroma ? 2 : 0) + (is_alpha ? 1 : 0);
+
+		for (int x = 0; x < width; x++)
+		{
+			float bgr[3], a;
+			ReadPixel(src + x * channels, channels, bgr, a);
+
+			float *d = dst + x * Channel;
+			if (is_chroma)
+			{
+				for (int c = 0; c < 2; c++)
+				{
+					const float (&f)[4] = m.forward[c + 1];
+					d[c] = f[0] * bgr[0] + f[1] * bgr[1] + f[2] * bgr[2] + f[3];
+				}
+			}
+
+			if (is_alpha)
+				d[Channel - 1] = a;
+		}
+	}
+
+	// č\z1s(plane1ȂPxA3ȂRGB)ƁACreateColorRow()̌`Ŋg債FƃAt@1sAo͉摜BGR(A)1s
+	// At@ΐFAt@ŊăZς݂߂(At@0̉f̐F0ɂ)
+	template<typename T>
+	void CreateOutputRow(const float *im, const int plane, const float *color, const bool is_alpha, const int width, const stColorMatrix &m, T *dst)
+	{
+		const int ColorChannel = (plane == 1 ? 2 : 0) + (is_alpha ? 1 : 0);
+		const int Channel = is_alpha ? 4 : 3;
+
+		for (int x = 0; x < width; x++)
+		{
+			const float *c = color + x * ColorChannel;
+
+			float bgr[3];
+			if (plane == 1)
+			{
+				const float y = im[x];
+				for (int r = 0; r < 3; r++)
+				{
+					const float (&f)[4] = m.inverse[r];
+					bgr[r] = f[0] * y + f[1] * c[0] + f[2] * c[1] + f[3];
+				}
+			}
+			else
+			{
+				bgr[0] = im[x * 3 + 2];
+				bgr[1] = im[x * 3 + 1];
+				bgr[2] = im[x * 3 + 0];
+			}
+
+			T *d = dst + x * Channel;
+			if (is_alpha)
+			{
+				const float a = c[ColorChannel - 1];
+				const float inv = a != 0.0f ? 1.0f / a : 0.0f;
+
+				for (int r = 0; r < 3; r++)
+					bgr[r] *= inv;
+
+				WritePixel(a, d + 3);
+			}
+
+			for (int r = 0; r < 3; r++)
+				WritePixel(bgr[r], d + r);
+		}
+	}
+
+	// cv::resize()cv::INTER_LINEARAcv::INTER_CUBICƓ(W̑ΉAWA[̉f̌JԂ)ŁAgk摜1s
+	// o͂1sɓ͂̍scɕԂĂ牡ɕԂ
+	// ͂̍srow_funcŕKvɂȂɍAԂɎgsێȂ̂ŁA͂Əo͂̂ǂ̉摜ŜȂ(o͂̍s͏ォ珇ɍ邱)
+	class RowResizer
+	{
+	public:
+		// ͂ys( x `l)ԂBbufɏbufԂĂAʂɎĂsԂĂ悢
+		typedef std::function<const float*(const int y, float *buf)> RowFunc;
+
+	private:
+		cv::Size_<int> src_size;
+		int channels;
+		int dst_width;
+		double scale_y;
+		// ԂɎgf̐(cv::INTER_LINEARȂ2Acv::INTER_CUBICȂ4)
+		int ksize;
+		RowFunc row_func;
+
+		std::vector<int> xofs;
+		std::vector<float> xcoeffs;
+		std::vector<float> vrow;
+
+		// ͂̍s̃LbV(y % ksizëʒuɒu)
+		std::vector<std::vector<float>> bufs;
+		std::vector<int> buf_rows;
+		std::vector<const float*> buf_ptrs;
+
+		void GetCoeffs(const float x, float *coeffs) const
+		{
+			if (ksize == 2)
+			{
+				coeffs[0] = 1.0f - x;
+				coeffs[1] = x;
+				return;
+			}
+
+			const float A = -0.75f;
+
+			coeffs[0] = ((A * (x + 1) - 5 * A) * (x + 1) + 8 * A) * (x + 1) - 4 * A;
+			coeffs[1] = ((A + 2) * x - (A + 3)) * x * x + 1;
+			coeffs[2] = ((A + 2) * (1 - x) - (A + 3)) * (1 - x) * (1 - x) + 1;
+			coeffs[3] = 1.0f - coeffs[0] - coeffs[1] - coeffs[2];
+		}
+
+		const float* SrcRow(const int y)
+		{
+			const int sy = std::min(std::max(y, 0), src_size.height - 1);
+			const int slot = sy % ksize;
+
+			if (buf_rows[slot] != sy)
+			{
+				buf_ptrs[slot] = row_func(sy, bufs[slot].data());
+				buf_rows[slot] = sy;
+			}
+
+			return buf_ptrs[slot];
+		}
+
+	public:
+		RowResizer(const cv::Size_<int> &Src_size, const int Channels, const cv::Size_<int> &dst_size, const int interpolation, const RowFunc &Row_func)
+			: src_size(Src_size), channels(Channels), dst_width(dst_size.width), scale_y((double)Src_size.height / dst_size.height),
+			ksize(interpolation == cv::INTER_CUBIC ? 4 : 2), row_func(Row_func), xofs(dst_size.width * ksize), xcoeffs(dst_size.width * ksize),
+			vrow(Src_size.width * Channels), bufs(ksize, std::vector<float>(Src_size.width * Channels)), buf_rows(ksize, -1), buf_ptrs(ksize, nullptr)
+		{
+			const double scale_x = (double)src_size.width / dst_size.width;
+
+			for (int x = 0; x < dst_width; x++)
+			{
+				float fx = (float)((x + 0.5) * scale_x - 0.5);
+				const int sx = (int)floor(fx);
+				fx -= sx;
+
+				GetCoeffs(fx, &xcoeffs[x * ksize]);
+				for (int k = 0; k < ksize; k++)
+					xofs[x * ksize + k] = std::min(std::max(sx + k - (ksize / 2 - 1), 0), src_size.width - 1) * channels;
+			}
+		}
+
+		// o͂ys(dst_width x `l)dstɏ
+		void Row(const int y, float *dst)
+		{
+			const int Num = src_size.width * channels;
+
+			float fy = (float)((y + 0.5) * scale_y - 0.5);
+			const int sy = (int)floor(fy);
+			fy -= sy;
+
+			float c[4];
+			GetCoeffs(fy, c);
+
+			const float *rows[4];
+			for (int k = 0; k < ksize; k++)
+				rows[k] = SrcRow(sy + k - (ksize / 2 - 1));
+
+			if (ksize == 2)
+			{
+				for (int i = 0; i < Num; i++)
+					vrow[i] = c[0] * rows[0][i] + c[1] * rows[1][i];
+			}
+			else
+			{
+				for (int i = 0; i < Num; i++)
+					vrow[i] = c[0] * rows[0][i] + c[1] * rows[1][i] + c[2] * rows[2][i] + c[3] * rows[3][i];
+			}
+
+			for (int x = 0; x < dst_width; x++)
+			{
+				const int *o = &xofs[x * ksize];
+				const float *w = &xcoeffs[x * ksize];
+
+				for (int ch = 0; ch < channels; ch++)
+				{
+					float v = 0.0f;
+					for (int k = 0; k < ksize; k++)
+						v += w[k] * vrow[o[k] + ch];
+
+					dst[x * channels + ch] = v;
+				}
+			}
+		}
+	};
 }
 
-Waifu2x::Waifu2x() : is_inited(false), isCuda(false), input_block(nullptr), dummy_data(nullptr), output_block(nullptr)
+// 풓XbhœɎs
+// run()̌ĂяõXbhthread_index 0ƂďɎQ
+class Waifu2xThreadPool
+{
+private:
+	std::vector<std::thread> threads;
+	std::mutex mtx;
+	std::condition_variable cond_start;
+	std::condition_variable cond_end;
+	std::function<void(const int)> func;
+	uint64_t generation;
+	int running_num;
+	bool is_exit;
+
+	void worker(const int thread_index)
+	{
+		uint64_t last_generation = 0;
+		for (;;)
+		{
+			std::function<void(const int)> f;
+			{
+				std::unique_lock<std::mutex> lock(mtx);
+				cond_start.wait(lock, [this, last_generation]() { return is_exit || generation != last_generation; });
+				if (is_exit)
+					return;
+
+				last_generation = generation;
+				f = func;
+			}
+
+			f(thread_index);
+
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				if (--running_num == 0)
+					cond_end.notify_one();
+			}
+		}
+	}
+
+public:
+	Waifu2xThreadPool(const int thread_num) : generation(0), running_num(0), is_exit(false)
+	{
+		for (int i = 1; i < thread_num; i++)
+			threads.emplace_back(std::bind(&Waifu2xThreadPool::worker, this, i));
+	}
+
+	~Waifu2xThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			is_exit = true;
+		}
+		cond_start.notify_all();
+
+		for (auto &t : threads)
+			t.join();
+	}
+
+	int thread_num() const
+	{
+		return (int)threads.size() + 1;
+	}
+
+	// funcSẴXbhŎsASďI܂ő҂
+	void run(const std::function<void(const int)> &Func)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			func = Func;
+			running_num = (int)threads.size();
+			generation++;
+		}
+		cond_start.notify_all();
+
+		Func(0);
+
+		std::unique_lock<std::mutex> lock(mtx);
+		cond_end.wait(lock, [this]() { return running_num == 0; });
+		func = nullptr;
+	}
+};
+
+// \zlbg[N(wKς݂̏d݂)Aŋߎgcapacity܂ŕێ
+// L[(f̃tH_, f, process, ubN̑傫)ŁÃXbh̃CX^X瓯Ɏg
+class Waifu2xNetCache
+{
+public:
+	struct stEntry
+	{
+		// d݂Caffẽlbg[N(processnative͎̎Ȃ)
+		boost::shared_ptr<caffe::Net<float>> weight_net;
+		// weight_net̒`Bd݂Llbg[N鎞Ɏg
+		boost::shared_ptr<caffe::NetParameter> net_param;
+		boost::shared_ptr<Waifu2xNativeNet> native_net;
+	};
+
+	typedef std::function<Waifu2x::eWaifu2xError(stEntry &entry)> constructFunc;
+
+private:
+	std::mutex mtx;
+	std::list<std::pair<std::string, stEntry>> entry_list;
+	size_t capacity;
+
+public:
+	// noise_scaleł̓mCYƊg̃lbg[N݂ɎĝŁAŒł͕ێ
+	Waifu2xNetCache(const int Capacity) : capacity(std::max(Capacity, 2))
+	{
+	}
+
+	// keỹlbg[NentryɕԂBconstruct_funcō\zĒǉAisConstructedtrueɂ
+	// \z͑̃Xbh҂̂ŁAlbg[Ndɍ\z邱Ƃ͂Ȃ
+	Waifu2x::eWaifu2xError get(const std::string &key, const constructFunc &construct_func, stEntry &entry, bool &isConstructed)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+		isConstructed = false;
+
+		for (auto it = entry_list.begin(); it != entry_list.end(); ++it)
+		{
+			if (it->first == key)
+			{
+				entry_list.splice(entry_list.begin(), entry_list, it);
+				entry = entry_list.front().second;
+				return Waifu2x::eWaifu2xError_OK;
+			}
+		}
+
+		stEntry e;
+		const auto ret = construct_func(e);
+		if (ret != Waifu2x::eWaifu2xError_OK)
+			return ret;
+
+		entry_list.push_front(std::make_pair(key, e));
+		// ǂolbg[NAgĂCX^XԂ͔jȂ
+		while (entry_list.size() > capacity)
+			entry_list.pop_back();
+
+		entry = e;
+		isConstructed = true;
+
+		return Waifu2x::eWaifu2xError_OK;
+	}
+};
+
+Waifu2x::Waifu2x() : is_inited(false), input_plane(0), isCuda(false), input_block(nullptr), output_block(nullptr), input_block2(nullptr), output_block2(nullptr)
 {
 }
 
@@ -100,6 +697,31 @@ Waifu2x::~Waifu2x()
 	destroy();
 }
 
+Waifu2x::Statistics::Statistics() : decode_time(0.0), color_convert_time(0.0), padding_time(0.0), pack_time(0.0), forward_time(0.0), unpack_time(0.0),
+	merge_time(0.0), encode_time(0.0), image_num(0), block_num(0), batch_num(0), batch_capacity(0), skip_block_num(0)
+{
+}
+
+Waifu2x::Statistics& Waifu2x::Statistics::operator+=(const Statistics &s)
+{
+	decode_time += s.decode_time;
+	color_convert_time += s.color_convert_time;
+	padding_time += s.padding_time;
+	pack_time += s.pack_time;
+	forward_time += s.forward_time;
+	unpack_time += s.unpack_time;
+	merge_time += s.merge_time;
+	encode_time += s.encode_time;
+
+	image_num += s.image_num;
+	block_num += s.block_num;
+	batch_num += s.batch_num;
+	batch_capacity += s.batch_capacity;
+	skip_block_num += s.skip_block_num;
+
+	return *this;
+}
+
 // cuDNNg邩`FbNBWindowŝ
 Waifu2x::eWaifu2xcuDNNError Waifu2x::can_use_cuDNN()
 {
@@ -187,9 +809,21 @@ cv::Mat Waifu2x::LoadMat(const std::string &path)
 }
 
 // 摜ǂݍŒl0.0f`1.0f͈̔͂ɕϊ
-Waifu2x::eWaifu2xError Waifu2x::LoadMat(cv::Mat &float_image, const std::string &input_file)
+Waifu2x::eWaifu2xError Waifu2x::LoadMat(cv::Mat &float_image, const std::string &input_file, Statistics *stat)
+{
+	cv::Mat original_image;
+	const eWaifu2xError ret = LoadOriginalMat(original_image, input_file, stat);
+	if (ret != eWaifu2xError_OK)
+		return ret;
+
+	return ConvertToFloatImage(original_image, float_image, stat);
+}
+
+Waifu2x::eWaifu2xError Waifu2x::LoadOriginalMat(cv::Mat &original_image, const std::string &input_file, Statistics *stat)
 {
-	cv::Mat original_image = cv::imread(input_file, cv::IMREAD_UNCHANGED);
+	StopWatch sw(stat ? &stat->decode_time : nullptr);
+
+	original_image = cv::imread(input_file, cv::IMREAD_UNCHANGED);
 	if (original_image.empty())
 	{
 		const eWaifu2xError ret = LoadMatBySTBI(original_image, input_file);
@@ -197,13 +831,62 @@ Waifu2x::eWaifu2xError Waifu2x::LoadMat(cv::Mat &float_image, const std::string
 			return ret;
 	}
 
-	cv::Mat convert;
-	original_image.convertTo(convert, CV_32F, 1.0 / 255.0);
-	original_image.release();
+	return eWaifu2xError_OK;
+}
 
-	if (convert.channels() == 1)
-		cv::cvtColor(convert, convert, cv::COLOR_GRAY2BGR);
-	else if (convert.channels() == 4)
+// ̃GR[hꂽ摜(摜t@C̒g)ǂݍŒl0.0f`1.0f͈̔͂ɕϊ
+Waifu2x::eWaifu2xError Waifu2x::LoadMat(cv::Mat &float_image, const std::vector<unsigned char> &input_buffer, Statistics *stat)
+{
+	cv::Mat original_image;
+	const eWaifu2xError ret = LoadOriginalMat(original_image, input_buffer, stat);
+	if (ret != eWaifu2xError_OK)
+		return ret;
+
+	return ConvertToFloatImage(original_image, float_image, stat);
+}
+
+Waifu2x::eWaifu2xError Waifu2x::LoadOriginalMat(cv::Mat &original_image, const std::vector<unsigned char> &input_buffer, Statistics *stat)
+{
+	if (input_buffer.empty())
+		return eWaifu2xError_FailedOpenInputFile;
+
+	StopWatch sw(stat ? &stat->decode_time : nullptr);
+
+	try
+	{
+		original_image = cv::imdecode(input_buffer, cv::IMREAD_UNCHANGED);
+	}
+	catch (...)
+	{
+	}
+
+	if (original_image.empty())
+	{
+		const eWaifu2xError ret = LoadMatBySTBI(original_image, input_buffer);
+		if (ret != eWaifu2xError_OK)
+			return ret;
+	}
+
+	return eWaifu2xError_OK;
+}
+
+// fR[h摜(CV_8ŨO[XP[ABGRABGRA)l0.0f`1.0f͈̔͂BGR(A)̉摜ɕϊ
+Waifu2x::eWaifu2xError Waifu2x::ConvertToFloatImage(const cv::Mat &original_image, cv::Mat &float_image, Statistics *stat)
+{
+	if (original_image.empty())
+		return eWaifu2xError_FailedOpenInputFile;
+
+	StopWatch sw(stat ? &stat->color_convert_time : nullptr);
+
+	if (original_image.channels() != 1 && original_image.channels() != 3 && original_image.channels() != 4)
+		return eWaifu2xError_InvalidParameter;
+
+	cv::Mat convert;
+	original_image.convertTo(convert, CV_32F, 1.0 / 255.0);
+
+	if (convert.channels() == 1)
+		cv::cvtColor(convert, convert, cv::COLOR_GRAY2BGR);
+	else if (convert.channels() == 4)
 	{
 		// At@`lt烿Zς݂ɂ
 
@@ -224,13 +907,52 @@ Waifu2x::eWaifu2xError Waifu2x::LoadMat(cv::Mat &float_image, const std::string
 	return eWaifu2xError_OK;
 }
 
+// gqJPEG摜肷(auto_scaleŃmCY邩ǂɎg)
+bool Waifu2x::IsJpeg(const std::string &path)
+{
+	const boost::filesystem::path ip(path);
+	const std::string ext = ip.extension().string();
+
+	return boost::iequals(ext, ".jpg") || boost::iequals(ext, ".jpeg");
+}
+
+// 擪̃}[J[(SOI)JPEG摜肷
+bool Waifu2x::IsJpeg(const std::vector<unsigned char> &input_buffer)
+{
+	return input_buffer.size() >= 3 && input_buffer[0] == 0xFF && input_buffer[1] == 0xD8 && input_buffer[2] == 0xFF;
+}
+
 Waifu2x::eWaifu2xError Waifu2x::LoadMatBySTBI(cv::Mat &float_image, const std::string &input_file)
 {
 	int x, y, comp;
-	stbi_uc *data = stbi_load(input_file.c_str(), &x, &y, &comp, 4);
+	stbi_uc *data = stbi_load(input_file.c_str(), &x, &y, &comp, 0);
+	if (!data)
+		return eWaifu2xError_FailedOpenInputFile;
+
+	const auto ret = CreateMatFromSTBI(float_image, data, x, y, comp);
+
+	stbi_image_free(data);
+
+	return ret;
+}
+
+Waifu2x::eWaifu2xError Waifu2x::LoadMatBySTBI(cv::Mat &float_image, const std::vector<unsigned char> &input_buffer)
+{
+	int x, y, comp;
+	stbi_uc *data = stbi_load_from_memory(input_buffer.data(), (int)input_buffer.size(), &x, &y, &comp, 0);
 	if (!data)
 		return eWaifu2xError_FailedOpenInputFile;
 
+	const auto ret = CreateMatFromSTBI(float_image, data, x, y, comp);
+
+	stbi_image_free(data);
+
+	return ret;
+}
+
+// stbiœǂݍ񂾉f(RGBApfBO)cv::MatɃRs[
+Waifu2x::eWaifu2xError Waifu2x::CreateMatFromSTBI(cv::Mat &float_image, const unsigned char *data, const int x, const int y, const int comp)
+{
 	int type = 0;
 	switch (comp)
 	{
@@ -246,7 +968,6 @@ Waifu2x::eWaifu2xError Waifu2x::LoadMatBySTBI(cv::Mat &float_image, const std::s
 
 	float_image = cv::Mat(cv::Size(x, y), type);
 
-	const auto LinePixel = float_image.step1() / float_image.channels();
 	const auto Channel = float_image.channels();
 	const auto Width = float_image.size().width;
 	const auto Height = float_image.size().height;
@@ -255,60 +976,41 @@ Waifu2x::eWaifu2xError Waifu2x::LoadMatBySTBI(cv::Mat &float_image, const std::s
 	assert(y == Height);
 	assert(Channel == comp);
 
-	auto ptr = float_image.data;
+	// RGBBGRɕϊȂRs[(O[XP[͂̂܂܃Rs[)
 	for (int i = 0; i < y; i++)
-	{
-		for (int j = 0; j < x; j++)
-		{
-			for (int ch = 0; ch < Channel; ch++)
-				ptr[(i * LinePixel + j) * comp + ch] = data[(i * x + j) * comp + ch];
-		}
-	}
-
-	stbi_image_free(data);
-
-	if (comp >= 3)
-	{
-		// RGBBGRɕϊ
-		for (int i = 0; i < y; i++)
-		{
-			for (int j = 0; j < x; j++)
-				std::swap(ptr[(i * LinePixel + j) * comp + 0], ptr[(i * LinePixel + j) * comp + 2]);
-		}
-	}
+		Waifu2xPixelKernel::SwapRB(data + i * x * comp, x, comp, float_image.ptr<unsigned char>(i));
 
 	return eWaifu2xError_OK;
 }
 
-// 摜Px̉摜o
-Waifu2x::eWaifu2xError Waifu2x::CreateBrightnessImage(const cv::Mat &float_image, cv::Mat &im)
+// length̕ӂ𕪊ubN̑傫
+// ubN̐output_sizeŕƓɂāA傫length܂ŏ̑傫(TileAlign̔{)܂ŏ
+// (130foutput_size 128ŕƁA128̃ubN2ł͂Ȃ72̃ubN2ɂȂ)
+// pfBO摜̑傫nĂ傫Ԃ
+int Waifu2x::GetTileSize(const int length) const
 {
-	cv::Mat converted_color;
-	cv::cvtColor(float_image, converted_color, ConvertMode);
-
-	std::vector<cv::Mat> planes;
-	cv::split(converted_color, planes);
+	const int num = std::max((length + output_size - 1) / output_size, 1);
+	const int tile = (length + num - 1) / num;
 
-	im = planes[0];
-	planes.clear();
-
-	return eWaifu2xError_OK;
+	return std::min((tile + TileAlign - 1) / TileAlign * TileAlign, output_size);
 }
 
-// ͉摜(Photoshopł)LoXTCYoutput_size̔{ɕύX
+// ͉摜(Photoshopł)LoXTCYAGetTileSize()Ō߂ubN̑傫̔{ɕύX
 // 摜͍zuA]cv::BORDER_REPLICATEŖ߂
 Waifu2x::eWaifu2xError Waifu2x::PaddingImage(const cv::Mat &input, cv::Mat &output)
 {
-	const auto h_blocks = (int)floor(input.size().width / output_size) + (input.size().width % output_size == 0 ? 0 : 1);
-	const auto w_blocks = (int)floor(input.size().height / output_size) + (input.size().height % output_size == 0 ? 0 : 1);
-	const auto height = offset + h_blocks * output_size + offset;
-	const auto width = offset + w_blocks * output_size + offset;
-	const auto pad_h1 = offset;
+	StopWatch sw(&statistics.padding_time);
+
+	const int tile_w = GetTileSize(input.size().width);
+	const int tile_h = GetTileSize(input.size().height);
+	const auto width = offset + (input.size().width + tile_w - 1) / tile_w * tile_w + offset;
+	const auto height = offset + (input.size().height + tile_h - 1) / tile_h * tile_h + offset;
 	const auto pad_w1 = offset;
-	const auto pad_h2 = (height - offset) - input.size().width;
-	const auto pad_w2 = (width - offset) - input.size().height;
+	const auto pad_h1 = offset;
+	const auto pad_w2 = (width - offset) - input.size().width;
+	const auto pad_h2 = (height - offset) - input.size().height;
 
-	cv::copyMakeBorder(input, output, pad_w1, pad_w2, pad_h1, pad_h2, cv::BORDER_REPLICATE);
+	cv::copyMakeBorder(input, output, pad_h1, pad_h2, pad_w1, pad_w2, cv::BORDER_REPLICATE);
 
 	return eWaifu2xError_OK;
 }
@@ -321,64 +1023,169 @@ Waifu2x::eWaifu2xError Waifu2x::Zoom2xAndPaddingImage(const cv::Mat &input, cv::
 	zoom_size.height *= 2;
 
 	cv::Mat zoom_image;
-	cv::resize(input, zoom_image, zoom_size, 0.0, 0.0, cv::INTER_NEAREST);
+	{
+		StopWatch sw(&statistics.padding_time);
+		cv::resize(input, zoom_image, zoom_size, 0.0, 0.0, cv::INTER_NEAREST);
+	}
 
 	return PaddingImage(zoom_image, output);
 }
 
-// ͉摜zoom_sizȇ傫cv::INTER_CUBICŊg債AF݂̂c
-Waifu2x::eWaifu2xError Waifu2x::CreateZoomColorImage(const cv::Mat &float_image, const cv::Size_<int> &zoom_size, std::vector<cv::Mat> &cubic_planes)
+// ͉摜̐F(Pxč\z鎞)ƃAt@()A͉摜̑傫̂܂CreateColorRow()̌`ō
+// FAt@color͋ɂ
+Waifu2x::eWaifu2xError Waifu2x::CreateColorImage(const cv::Mat &src_image, cv::Mat &color)
 {
-	cv::Mat zoom_cubic_image;
-	cv::resize(float_image, zoom_cubic_image, zoom_size, 0.0, 0.0, cv::INTER_CUBIC);
+	const bool is_chroma = input_plane == 1;
+	const bool is_alpha = src_image.channels() == 4;
+	const int Channel = (is_chroma ? 2 : 0) + (is_alpha ? 1 : 0);
 
-	cv::Mat converted_cubic_image;
-	cv::cvtColor(zoom_cubic_image, converted_cubic_image, ConvertMode);
-	zoom_cubic_image.release();
+	color.release();
+	if (Channel == 0)
+		return eWaifu2xError_OK;
 
-	cv::split(converted_cubic_image, cubic_planes);
-	converted_cubic_image.release();
+	const stColorMatrix &m = GetColorMatrix();
 
-	// Y͎gȂ̂ŉ
-	cubic_planes[0].release();
+	color = cv::Mat(src_image.size(), CV_32FC(Channel));
+	for (int y = 0; y < src_image.rows; y++)
+	{
+		if (src_image.depth() == CV_8U)
+			CreateColorRow(src_image.ptr<unsigned char>(y), src_image.cols, src_image.channels(), is_chroma, is_alpha, m, color.ptr<float>(y));
+		else
+			CreateColorRow(src_image.ptr<float>(y), src_image.cols, src_image.channels(), is_chroma, is_alpha, m, color.ptr<float>(y));
+	}
 
 	return eWaifu2xError_OK;
 }
 
 // ft@Clbg[N\z
 // processcudnnw肳ȂꍇcuDNNĂяoȂ悤ɕύX
-Waifu2x::eWaifu2xError Waifu2x::ConstractNet(boost::shared_ptr<caffe::Net<float>> &net, const std::string &model_path, const std::string &param_path, const std::string &process)
+// d݂̓LbV΃LbVǂݍ݁AJSONǂݍŃLbV
+Waifu2x::eWaifu2xError Waifu2x::ConstractNet(boost::shared_ptr<caffe::Net<float>> &net, boost::shared_ptr<caffe::NetParameter> &net_param, const std::string &model_path,
+	const std::string &param_path, const std::string &process)
 {
-	const std::string caffemodel_path = param_path + ".caffemodel";
-	const std::string modelbin_path = model_path + ".protobin";
-
-	FILE *fp = fopen(caffemodel_path.c_str(), "rb");
-	const bool isModelExist = fp != nullptr;
-	if (fp) fclose(fp);
+	caffe::NetParameter param;
+	if (!caffe::ReadProtoFromTextFile(model_path, &param))
+		return eWaifu2xError_FailedOpenModelFile;
 
-	fp = fopen(modelbin_path.c_str(), "rb");
-	const bool isModelBinExist = fp != nullptr;
-	if (fp) fclose(fp);
+	const auto ret = SetParameter(param);
+	if (ret != eWaifu2xError_OK)
+		return ret;
 
-	caffe::NetParameter param;
-	if (isModelExist && isModelBinExist && caffe::ReadProtoFromBinaryFile(modelbin_path, &param))
+	try
 	{
-		const auto ret = SetParameter(param);
-		if (ret != eWaifu2xError_OK)
-			return ret;
-
 		net = boost::shared_ptr<caffe::Net<float>>(new caffe::Net<float>(param));
-		net->CopyTrainedLayersFrom(caffemodel_path);
+	}
+	catch (...)
+	{
+		return eWaifu2xError_FailedConstructModel;
+	}
 
-		input_plane = param.input_dim(1);
+	net_param = boost::shared_ptr<caffe::NetParameter>(new caffe::NetParameter(param));
+
+	const auto cache_dirs = GetModelCacheDirs(param_path);
+
+	for (const auto &dir : cache_dirs)
+	{
+		Waifu2xModelCache cache;
+		if (cache.Load(Waifu2xModelCache::GetCachePath(dir, param_path), param_path) && SetWeights(net, cache.layers()) == eWaifu2xError_OK)
+			return eWaifu2xError_OK;
 	}
+
+	return LoadParameterFromJson(net, param_path, cache_dirs);
+}
+
+// d݂̃LbVutH_̌(D悷鏇)
+// w肪΃fƓtH_ŁAɏ߂Ȃ̂߂ɈꎞtH_ɂ
+std::vector<std::string> Waifu2x::GetModelCacheDirs(const std::string &param_path) const
+{
+	std::vector<std::string> dirs;
+
+	if (!option.model_cache_dir.empty())
+		dirs.push_back(option.model_cache_dir);
 	else
 	{
-		const auto ret = LoadParameterFromJson(net, model_path, param_path);
-		if (ret != eWaifu2xError_OK)
-			return ret;
+		dirs.push_back(boost::filesystem::path(param_path).parent_path().string());
+
+		boost::system::error_code error;
+		const auto temp_dir = boost::filesystem::temp_directory_path(error);
+		if (!error)
+			dirs.push_back((temp_dir / "waifu2x-caffe").string());
+	}
+
+	return dirs;
+}
+
+// layers̏d݂net̏ݍݑwɐݒ肷
+Waifu2x::eWaifu2xError Waifu2x::SetWeights(boost::shared_ptr<caffe::Net<float>> &net, const std::vector<Waifu2xModelCache::stLayer> &layers)
+{
+	if ((int)layers.size() != layer_num)
+		return eWaifu2xError_FailedParseModelFile;
+
+	const int inputPlane = layers.front().input_plane;
+	const int outputPlane = layers.back().output_plane;
+
+	if (inputPlane == 0 || outputPlane == 0)
+		return eWaifu2xError_FailedParseModelFile;
+
+	if (inputPlane != outputPlane)
+		return eWaifu2xError_FailedParseModelFile;
+
+	std::vector<boost::shared_ptr<caffe::Layer<float>>> list;
+	auto &v = net->layers();
+	for (auto &l : v)
+	{
+		auto &bv = l->blobs();
+		if (bv.size() > 0)
+			list.push_back(l);
+	}
+
+	if (list.size() != layers.size())
+		return eWaifu2xError_FailedConstructModel;
+
+	// ォ\zlbg[NAubÑobt@mۂƓ͂̃`lłȂ΂ȂȂ
+	if (input_plane != 0 && input_plane != inputPlane)
+		return eWaifu2xError_FailedConstructModel;
+
+	try
+	{
+		for (size_t i = 0; i < layers.size(); i++)
+		{
+			const auto &l = layers[i];
+
+			auto &b0 = list[i]->blobs()[0];
+			auto &b1 = list[i]->blobs()[1];
+
+			if (!(b0->count() == l.output_plane * l.input_plane * l.kernel_height * l.kernel_width))
+				return eWaifu2xError_FailedConstructModel;
+
+			if (!(b1->count() == l.output_plane))
+				return eWaifu2xError_FailedConstructModel;
+
+			float *b0Ptr = nullptr;
+			float *b1Ptr = nullptr;
+
+			if (caffe::Caffe::mode() == caffe::Caffe::CPU)
+			{
+				b0Ptr = b0->mutable_cpu_data();
+				b1Ptr = b1->mutable_cpu_data();
+			}
+			else
+			{
+				b0Ptr = b0->mutable_gpu_data();
+				b1Ptr = b1->mutable_gpu_data();
+			}
+
+			caffe::caffe_copy(b0->count(), l.weight, b0Ptr);
+			caffe::caffe_copy(b1->count(), l.bias, b1Ptr);
+		}
+	}
+	catch (...)
+	{
+		return eWaifu2xError_FailedConstructModel;
 	}
 
+	input_plane = inputPlane;
+
 	return eWaifu2xError_OK;
 }
 
@@ -392,7 +1199,8 @@ Waifu2x::eWaifu2xError Waifu2x::SetParameter(caffe::NetParameter &param) const
 		if (mid->size() != 4)
 			return eWaifu2xError_FailedParseModelFile;
 
-		*mid->Mutable(0) = batch_size;
+		// native̎͏d݂o߂ɍ\ẑŁAuuĂ
+		*mid->Mutable(0) = process == "native" ? 1 : batch_size;
 		*mid->Mutable(2) = input_block_size;
 		*mid->Mutable(3) = input_block_size;
 	}
@@ -420,23 +1228,9 @@ Waifu2x::eWaifu2xError Waifu2x::SetParameter(caffe::NetParameter &param) const
 	return eWaifu2xError_OK;
 }
 
-Waifu2x::eWaifu2xError Waifu2x::LoadParameterFromJson(boost::shared_ptr<caffe::Net<float>> &net, const std::string &model_path, const std::string &param_path)
+// JSONd݂ǂݍnetɐݒ肵Acache_dirŝǂꂩɃLbV
+Waifu2x::eWaifu2xError Waifu2x::LoadParameterFromJson(boost::shared_ptr<caffe::Net<float>> &net, const std::string &param_path, const std::vector<std::string> &cache_dirs)
 {
-	const std::string caffemodel_path = param_path + ".caffemodel";
-	const std::string modelbin_path = model_path + ".protobin";
-
-	caffe::NetParameter param;
-	if (!caffe::ReadProtoFromTextFile(model_path, &param))
-		return eWaifu2xError_FailedOpenModelFile;
-
-	caffe::WriteProtoToBinaryFile(param, modelbin_path);
-
-	const auto ret = SetParameter(param);
-	if (ret != eWaifu2xError_OK)
-		return ret;
-
-	net = boost::shared_ptr<caffe::Net<float>>(new caffe::Net<float>(param));
-
 	rapidjson::Document d;
 	std::vector<char> jsonBuf;
 
@@ -464,88 +1258,24 @@ Waifu2x::eWaifu2xError Waifu2x::LoadParameterFromJson(boost::shared_ptr<caffe::N
 		return eWaifu2xError_FailedParseModelFile;
 	}
 
-	if (d.Size() != 7)
-		return eWaifu2xError_FailedParseModelFile;
-
-	int inputPlane = 0;
-	int outputPlane = 0;
-	try
-	{
-		inputPlane = d[0]["nInputPlane"].GetInt();
-		outputPlane = d[d.Size() - 1]["nOutputPlane"].GetInt();
-	}
-	catch (...)
-	{
-		return eWaifu2xError_FailedParseModelFile;
-	}
-
-	if (inputPlane == 0 || outputPlane == 0)
-		return eWaifu2xError_FailedParseModelFile;
-
-	if (inputPlane != outputPlane)
+	if (!d.IsArray() || (int)d.Size() != layer_num)
 		return eWaifu2xError_FailedParseModelFile;
 
-	//if (param.layer_size() < 17)
-	//	return eWaifu2xError_FailedParseModelFile;
-
-	std::vector<boost::shared_ptr<caffe::Layer<float>>> list;
-	auto &v = net->layers();
-	for (auto &l : v)
-	{
-		auto lk = l->type();
-		auto &bv = l->blobs();
-		if (bv.size() > 0)
-			list.push_back(l);
-	}
+	std::vector<std::vector<float>> weightLists(d.Size());
+	std::vector<std::vector<float>> biasLists(d.Size());
+	std::vector<Waifu2xModelCache::stLayer> layers;
 
 	try
 	{
-		std::vector<float> weightList;
-		std::vector<float> biasList;
-
 		int count = 0;
-		for (auto it = d.Begin(); it != d.End(); ++it)
+		for (auto it = d.Begin(); it != d.End(); ++it, count++)
 		{
 			const auto &weight = (*it)["weight"];
-			const auto nInputPlane = (*it)["nInputPlane"].GetInt();
-			const auto nOutputPlane = (*it)["nOutputPlane"].GetInt();
-			const auto kW = (*it)["kW"].GetInt();
 			const auto &bias = (*it)["bias"];
 
-			auto leyer = list[count];
-
-			auto &b0 = leyer->blobs()[0];
-			auto &b1 = leyer->blobs()[1];
-
-			float *b0Ptr = nullptr;
-			float *b1Ptr = nullptr;
-
-			if (caffe::Caffe::mode() == caffe::Caffe::CPU)
-			{
-				b0Ptr = b0->mutable_cpu_data();
-				b1Ptr = b1->mutable_cpu_data();
-			}
-			else
-			{
-				b0Ptr = b0->mutable_gpu_data();
-				b1Ptr = b1->mutable_gpu_data();
-			}
-
-			const auto WeightSize1 = weight.Size();
-			const auto WeightSize2 = weight[0].Size();
-			const auto KernelHeight = weight[0][0].Size();
-			const auto KernelWidth = weight[0][0][0].Size();
+			std::vector<float> &weightList = weightLists[count];
+			std::vector<float> &biasList = biasLists[count];
 
-			if (!(b0->count() == WeightSize1 * WeightSize2 * KernelHeight * KernelWidth))
-				return eWaifu2xError_FailedConstructModel;
-
-			if (!(b1->count() == bias.Size()))
-				return eWaifu2xError_FailedConstructModel;
-
-			weightList.resize(0);
-			biasList.resize(0);
-
-			size_t weightCount = 0;
 			for (auto it2 = weight.Begin(); it2 != weight.End(); ++it2)
 			{
 				for (auto it3 = (*it2).Begin(); it3 != (*it2).End(); ++it3)
@@ -558,477 +1288,2284 @@ Waifu2x::eWaifu2xError Waifu2x::LoadParameterFromJson(boost::shared_ptr<caffe::N
 				}
 			}
 
-			caffe::caffe_copy(b0->count(), weightList.data(), b0Ptr);
-
 			for (auto it2 = bias.Begin(); it2 != bias.End(); ++it2)
 				biasList.push_back((float)it2->GetDouble());
 
-			caffe::caffe_copy(b1->count(), biasList.data(), b1Ptr);
-
-			count++;
-		}
+			Waifu2xModelCache::stLayer l;
+			l.input_plane = (*it)["nInputPlane"].GetInt();
+			l.output_plane = (*it)["nOutputPlane"].GetInt();
+			l.kernel_width = weight[0][0][0].Size();
+			l.kernel_height = weight[0][0].Size();
+			l.weight = weightList.data();
+			l.bias = biasList.data();
 
-		net->ToProto(&param);
+			if (weightList.size() != (size_t)l.output_plane * l.input_plane * l.kernel_height * l.kernel_width || biasList.size() != (size_t)l.output_plane)
+				return eWaifu2xError_FailedParseModelFile;
 
-		caffe::WriteProtoToBinaryFile(param, caffemodel_path);
+			layers.push_back(l);
+		}
 	}
 	catch (...)
 	{
-		return eWaifu2xError_FailedConstructModel;
+		return eWaifu2xError_FailedParseModelFile;
 	}
 
-	input_plane = inputPlane;
+	const auto ret = SetWeights(net, layers);
+	if (ret != eWaifu2xError_OK)
+		return ret;
+
+	// LbV߂ȂĂῗł̂ŁAsĂ̌ɂ
+	for (const auto &dir : cache_dirs)
+	{
+		if (Waifu2xModelCache::Write(Waifu2xModelCache::GetCachePath(dir, param_path), param_path, layers))
+			break;
+	}
 
 	return eWaifu2xError_OK;
 }
 
 // lbg[Ngĉ摜č\z
-Waifu2x::eWaifu2xError Waifu2x::ReconstructImage(boost::shared_ptr<caffe::Net<float>> net, cv::Mat &im)
+Waifu2x::eWaifu2xError Waifu2x::ReconstructImage(const eNetType type, cv::Mat &im)
 {
-	const auto Height = im.size().height;
-	const auto Width = im.size().width;
-	const auto Line = im.step1();
+	std::vector<cv::Mat> ims(1, im);
 
-	assert(Width % output_size == 0);
-	assert(Height % output_size == 0);
+	const auto ret = ReconstructImage(type, ims);
+	if (ret != eWaifu2xError_OK)
+		return ret;
 
-	assert(im.channels() == 1 || im.channels() == 3);
+	im = ims[0];
 
-	cv::Mat outim(im.rows, im.cols, im.type());
+	return eWaifu2xError_OK;
+}
 
-	// float *imptr = (float *)im.data;
-	float *imptr = (float *)outim.data;
+// lbg[Ngĕ̉摜܂Ƃ߂čč\z
+// SẲ摜̃ubNɕׂbatch_size̂ŁA摜Ă~job`܂
+Waifu2x::eWaifu2xError Waifu2x::ReconstructImage(const eNetType type, std::vector<cv::Mat> &ims)
+{
+	std::vector<stBlock> blocks;
+	std::vector<cv::Mat> outims(ims.size());
 
-	try
+	for (size_t k = 0; k < ims.size(); k++)
 	{
-		auto input_blobs = net->input_blobs();
-		auto input_blob = net->input_blobs()[0];
+		const cv::Mat &im = ims[k];
 
-		input_blob->Reshape(batch_size, input_plane, input_block_size, input_block_size);
+		const auto Height = im.size().height;
+		const auto Width = im.size().width;
 
-		assert(im.channels() == input_plane);
-		assert(input_blob->shape(1) == input_plane);
+		// PaddingImage()ŃpfBO摜Ȃ̂ŁAubN̑傫Ŋ؂
+		const int TileWidth = GetTileSize(Width);
+		const int TileHeight = GetTileSize(Height);
 
-		const int WidthNum = Width / output_size;
-		const int HeightNum = Height / output_size;
+		assert(Width % TileWidth == 0);
+		assert(Height % TileHeight == 0);
 
-		const int BlockNum = WidthNum * HeightNum;
+		assert(im.channels() == 1 || im.channels() == 3);
+		assert(im.channels() == input_plane);
 
-		const int input_block_plane_size = input_block_size * input_block_size * input_plane;
-		const int output_block_plane_size = output_block_size * output_block_size * input_plane;
+		outims[k] = cv::Mat(im.rows, im.cols, im.type());
 
-		const int output_padding = inner_padding + outer_padding - layer_num;
+		const int WidthNum = Width / TileWidth;
+		const int HeightNum = Height / TileHeight;
 
-		// 摜(̓s)output_size*output_sizeɕčč\z
-		for (int num = 0; num < BlockNum; num += batch_size)
+		for (int hn = 0; hn < HeightNum; hn++)
 		{
-			const int processNum = (BlockNum - num) >= batch_size ? batch_size : BlockNum - num;
-
-			if (processNum < batch_size)
-				input_blob->Reshape(processNum, input_plane, input_block_size, input_block_size);
-
-			for (int n = 0; n < processNum; n++)
+			for (int wn = 0; wn < WidthNum; wn++)
 			{
-				const int wn = (num + n) % WidthNum;
-				const int hn = (num + n) / WidthNum;
+				stBlock b;
+				b.image = (int)k;
+				b.w = wn * TileWidth;
+				b.h = hn * TileHeight;
+				b.out_w = b.w;
+				b.out_h = b.h;
+				b.width = TileWidth;
+				b.height = TileHeight;
+
+				blocks.push_back(b);
+			}
+		}
+	}
 
-				const int w = wn * output_size;
-				const int h = hn * output_size;
+	std::vector<stFlatBlock> flat_blocks;
+	RemoveFlatBlocks(ims, blocks, flat_blocks);
 
-				if (w + crop_size <= Width && h + crop_size <= Height)
-				{
-					int x, y;
-					x = w - inner_padding;
-					y = h - inner_padding;
+	// 傫̃ubN̉摜悤ɕבւāA~job`𖄂߂₷
+	SortBlocks(blocks);
 
-					int width, height;
+	const bool isResident = option.device_resident && process != "native" && !cpu_thread_pool && IsResidentInBudget(ims, outims);
 
-					width = crop_size + inner_padding * 2;
-					height = crop_size + inner_padding * 2;
+	if (!blocks.empty())
+	{
+		const auto ret = isResident ? ReconstructResidentBlocks(type, ims, outims, blocks) : ReconstructBlocks(type, ims, outims, blocks);
+		if (ret != eWaifu2xError_OK)
+			return ret;
+	}
 
-					int top, bottom, left, right;
+	// ReconstructResidentBlocks()͌ʂ̉摜ŜûŁARȃubN͍Ōɖ߂
+	FillFlatBlocks(outims, flat_blocks);
 
-					top = outer_padding;
-					bottom = outer_padding;
-					left = outer_padding;
-					right = outer_padding;
+	ims = outims;
 
-					if (x < 0)
-					{
-						left += -x;
-						width -= -x;
-						x = 0;
-					}
+	return eWaifu2xError_OK;
+}
 
-					if (x + width > Width)
-					{
-						right += (x + width) - Width;
-						width = Width - x;
-					}
+// blocksŎw肵ubNlbg[NɒʂāAʂoutimsɏ
+// ubNbatch_sizeACPŨXbhv[Εɏ
+Waifu2x::eWaifu2xError Waifu2x::ReconstructBlocks(const eNetType type, const std::vector<cv::Mat> &ims, std::vector<cv::Mat> &outims, const std::vector<stBlock> &blocks)
+{
+	const auto ret = PrepareNet(type);
+	if (ret != eWaifu2xError_OK)
+		return ret;
 
-					if (y < 0)
-					{
-						top += -y;
-						height -= -y;
-						y = 0;
-					}
+	const std::vector<stBatch> batches = SplitBatches(blocks);
+	const int BatchNum = (int)batches.size();
 
-					if (y + height > Height)
-					{
-						bottom += (y + height) - Height;
-						height = Height - y;
-					}
+	if (!cpu_thread_pool)
+	{
+		// ~job`鎞́AvZɑÕ~job`̏߂Ɛ؂os
+		if (BatchNum > 1)
+			return ReconstructPipelinedBlocks(type, ims, outims, blocks);
+
+		// 摜(̓s)ubNɕčč\z
+		for (const auto &batch : batches)
+		{
+			const auto ret = ProcessBlock(type, ims, outims, blocks, batch.num, batch.process_num);
+			if (ret != eWaifu2xError_OK)
+				return ret;
+		}
+	}
+	else
+	{
+		// eXbh͎̃lbg[NŁA肪󂢂玟̃~job`(擪珇ɕ񂾃ubNs̈ꕔ)ɍs
+		std::atomic<int> next_batch(0);
+		std::atomic<bool> isError(false);
+		std::atomic<int> error(eWaifu2xError_OK);
 
-					cv::Mat someimg = im(cv::Rect(x, y, width, height));
+		cpu_thread_pool->run([&](const int thread_index)
+		{
+			Waifu2x &worker = thread_index == 0 ? *this : *cpu_workers[thread_index - 1];
 
-					cv::Mat someborderimg;
-					// 摜𒆉ɃpfBOB]cv::BORDER_REPLICATEŖ߂
-					// imŉf݂镔͗]ƔFȂAinner_paddinglayer_numouter_padding1ȏȂ炻̉̕f͌ʉ摜ƂĎoɂ͉eȂ
-					cv::copyMakeBorder(someimg, someborderimg, top, bottom, left, right, cv::BORDER_REPLICATE);
-					someimg.release();
+			caffe::Caffe::set_mode(caffe::Caffe::CPU);
 
-					// 摜𒼗ɕϊ
-					{
-						float *fptr = input_block + (input_block_plane_size * n);
-						const float *uptr = (const float *)someborderimg.data;
-
-						const auto Line = someborderimg.step1();
-
-						if (someborderimg.channels() == 1)
-						{
-							if (input_block_size == Line)
-								memcpy(fptr, uptr, input_block_size * input_block_size * sizeof(float));
-							else
-							{
-								for (int i = 0; i < input_block_size; i++)
-									memcpy(fptr + i * input_block_size, uptr + i * Line, input_block_size * sizeof(float));
-							}
-						}
-						else
-						{
-							const auto LinePixel = someborderimg.step1() / someborderimg.channels();
-							const auto Channel = someborderimg.channels();
-							const auto Width = someborderimg.size().width;
-							const auto Height = someborderimg.size().height;
-
-							for (int i = 0; i < Height; i++)
-							{
-								for (int j = 0; j < LinePixel; j++)
-								{
-									for (int ch = 0; ch < Channel; ch++)
-										fptr[(ch * Height + i) * Width + j] = uptr[(i * LinePixel + j) * Channel + ch];
-								}
-							}
-
-							/*
-							{
-								cv::Mat im(someborderimg.size(), CV_32F, fptr, Width * sizeof(float));
-
-								cv::Mat write_iamge;
-								im.convertTo(write_iamge, CV_8U, 255.0);
-								im.release();
-
-								if (!cv::imwrite("test_in.png", write_iamge))
-									return eWaifu2xError_FailedOpenOutputFile;
-							}
-							*/
-						}
-					}
+			for (;;)
+			{
+				const int i = next_batch.fetch_add(1);
+				if (i >= BatchNum || isError)
+					break;
+
+				const auto ret = worker.ProcessBlock(type, ims, outims, blocks, batches[i].num, batches[i].process_num);
+				if (ret != eWaifu2xError_OK)
+				{
+					error = ret;
+					isError = true;
 				}
 			}
+		});
 
-			assert(input_blob->count() == input_block_plane_size * processNum);
+		if (isError)
+			return (eWaifu2xError)error.load();
+	}
 
-			// lbg[Nɉ摜
-			input_blob->set_cpu_data(input_block);
+	return eWaifu2xError_OK;
+}
 
-			// vZ
-			auto out = net->ForwardPrefilled(nullptr);
+// 傫̃ubN悤(ȊȌԂ͕ς)בւ
+void Waifu2x::SortBlocks(std::vector<stBlock> &blocks)
+{
+	std::stable_sort(blocks.begin(), blocks.end(), [](const stBlock &a, const stBlock &b)
+	{
+		return a.height != b.height ? a.height > b.height : a.width > b.width;
+	});
+}
 
-			auto b = out[0];
+// blocks擪珇ɁA傫̃ubNbatch_size܂łԃ~job`ɕ
+std::vector<Waifu2x::stBatch> Waifu2x::SplitBatches(const std::vector<stBlock> &blocks) const
+{
+	std::vector<stBatch> batches;
 
-			assert(b->count() == output_block_plane_size * processNum);
+	const int BlockNum = (int)blocks.size();
+	for (int num = 0; num < BlockNum;)
+	{
+		stBatch batch;
+		batch.num = num;
+		batch.process_num = 1;
 
-			const float *ptr = nullptr;
+		while (batch.process_num < batch_size && num + batch.process_num < BlockNum &&
+			blocks[num + batch.process_num].width == blocks[num].width && blocks[num + batch.process_num].height == blocks[num].height)
+			batch.process_num++;
 
-			if (caffe::Caffe::mode() == caffe::Caffe::CPU)
-				ptr = b->cpu_data();
-			else
-				ptr = b->gpu_data();
+		batches.push_back(batch);
+		num += batch.process_num;
+	}
+
+	return batches;
+}
+
+// InitOption::skip_flat_blockLȎAʂɉe͈(inner_padding܂)̉fRȃubNblocks菜flat_blocksɈڂ
+// At@t̉摜̓Zς݂Ȃ̂ŁASɓȕ0ŕRɂȂ
+void Waifu2x::RemoveFlatBlocks(const std::vector<cv::Mat> &ims, std::vector<stBlock> &blocks, std::vector<stFlatBlock> &flat_blocks)
+{
+	if (!option.skip_flat_block)
+		return;
+
+	StopWatch sw(&statistics.pack_time);
+
+	const float Tolerance = option.flat_block_tolerance / 255.0f;
+
+	std::vector<stBlock> remain_blocks;
+	remain_blocks.reserve(blocks.size());
+
+	for (const auto &b : blocks)
+	{
+		const cv::Mat &im = ims[b.image];
+
+		// PackBlocks()Ő؂ó͈B摜̊O͈͂̔͂̒[̉fŖ߂̂ŁAׂ͈̔͂΂悢
+		const int x0 = std::max(b.w - inner_padding, 0);
+		const int y0 = std::max(b.h - inner_padding, 0);
+		const int x1 = std::min(b.w + b.width + inner_padding, im.cols);
+		const int y1 = std::min(b.h + b.height + inner_padding, im.rows);
+
+		stFlatBlock fb;
+		fb.block = b;
+
+		if (IsFlatRegion(im, cv::Rect(x0, y0, x1 - x0, y1 - y0), Tolerance, fb.value))
+			flat_blocks.push_back(fb);
+		else
+			remain_blocks.push_back(b);
+	}
+
+	blocks.swap(remain_blocks);
+
+	statistics.skip_block_num += flat_blocks.size();
+}
+
+// RemoveFlatBlocks()Ŏ菜ubN̏o͂Albg[Nɒʂɂꂼ̒lŖ߂
+void Waifu2x::FillFlatBlocks(std::vector<cv::Mat> &outims, const std::vector<stFlatBlock> &flat_blocks)
+{
+	StopWatch sw(&statistics.unpack_time);
+
+	for (const auto &fb : flat_blocks)
+	{
+		const stBlock &b = fb.block;
+		outims[b.image](cv::Rect(b.out_w, b.out_h, b.width, b.height)).setTo(fb.value);
+	}
+}
 
-			caffe::caffe_copy(output_block_plane_size * processNum, ptr, output_block);
+// ReconstructBlocks()ƓAubN̐؂oE߂ƃlbg[ŇvZʁX̃Xbhŕsčs
+// o͂̃obt@2ggA~job`ivZĂԂɁA~job`i+1̐؂oƃ~job`i-1̏߂s
+// lbg[ŇvZ(Caffe̐ݒ̓XbhȂ̂)ĂяõXbhōsA؂oƏ߂VXbhōs
+Waifu2x::eWaifu2xError Waifu2x::ReconstructPipelinedBlocks(const eNetType type, const std::vector<cv::Mat> &ims, std::vector<cv::Mat> &outims, const std::vector<stBlock> &blocks)
+{
+	const std::vector<stBatch> batches = SplitBatches(blocks);
+	const int BatchNum = (int)batches.size();
+
+	float *inputs[2] = { input_block, input_block2 };
+	float *outputs[2] = { output_block, output_block2 };
+
+	std::mutex mtx;
+	std::condition_variable cond;
+	// ؂oAvZA߂I~job`̐
+	int packed_num = 0;
+	int forwarded_num = 0;
+	int unpacked_num = 0;
+	eWaifu2xError pack_ret = eWaifu2xError_OK;
+	eWaifu2xError forward_ret = eWaifu2xError_OK;
+
+	const auto IsError = [&]()
+	{
+		return pack_ret != eWaifu2xError_OK || forward_ret != eWaifu2xError_OK;
+	};
 
-			for (int n = 0; n < processNum; n++)
+	std::thread pack_thread([&]()
+	{
+		for (int i = 0; i <= BatchNum; i++)
+		{
+			// ̓obt@(i % 2)gĂ~job`i-2̌vŹAO~job`i-2߂OɏIĂ
+			if (i < BatchNum)
 			{
-				const int wn = (num + n) % WidthNum;
-				const int hn = (num + n) / WidthNum;
+				const auto ret = PackBlocks(ims, blocks, batches[i].num, batches[i].process_num, inputs[i % 2]);
 
-				const int w = wn * output_size;
-				const int h = hn * output_size;
+				{
+					std::lock_guard<std::mutex> lock(mtx);
+					if (ret != eWaifu2xError_OK)
+						pack_ret = ret;
+					else
+						packed_num = i + 1;
+				}
+				cond.notify_all();
 
-				const float *fptr = output_block + (output_block_plane_size * n);
+				if (ret != eWaifu2xError_OK)
+					return;
+			}
 
-				// ʂo͉摜ɃRs[
-				if (outim.channels() == 1)
+			if (i >= 1)
+			{
 				{
-					for (int i = 0; i < crop_size; i++)
-						memcpy(imptr + (h + i) * Line + w, fptr + (i + output_padding) * output_block_size + output_padding, crop_size * sizeof(float));
+					std::unique_lock<std::mutex> lock(mtx);
+					cond.wait(lock, [&]() { return forwarded_num >= i || IsError(); });
+					if (IsError())
+						return;
 				}
-				else
+
+				const auto ret = UnpackBlocks(outims, blocks, batches[i - 1].num, batches[i - 1].process_num, outputs[(i - 1) % 2]);
+
 				{
-					const auto LinePixel = outim.step1() / outim.channels();
-					const auto Channel = outim.channels();
+					std::lock_guard<std::mutex> lock(mtx);
+					if (ret != eWaifu2xError_OK)
+						pack_ret = ret;
+					else
+						unpacked_num = i;
+				}
+				cond.notify_all();
 
-					for (int i = 0; i < crop_size; i++)
-					{
-						for (int j = 0; j < crop_size; j++)
-						{
-							for (int ch = 0; ch < Channel; ch++)
-								imptr[((h + i) * LinePixel + (w + j)) * Channel + ch] = fptr[(ch * output_block_size + i + output_padding) * output_block_size + j + output_padding];
-						}
-					}
+				if (ret != eWaifu2xError_OK)
+					return;
+			}
+		}
+	});
 
-					/*
-					{
-						cv::Mat im(someborderimg.size(), CV_32F, fptr, Width * sizeof(float));
+	for (int i = 0; i < BatchNum; i++)
+	{
+		// ~job`i̐؂oƁAo̓obt@(i % 2)gĂ~job`i-2̏߂Î҂
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			cond.wait(lock, [&]() { return (packed_num > i && unpacked_num >= i - 1) || IsError(); });
+			if (IsError())
+				break;
+		}
 
-						cv::Mat write_iamge;
-						im.convertTo(write_iamge, CV_8U, 255.0);
-						im.release();
+		const stBlock &b = blocks[batches[i].num];
 
-						if (!cv::imwrite("test_in.png", write_iamge))
-							return eWaifu2xError_FailedOpenOutputFile;
-					}
-					*/
+		const auto ret = ForwardBlocks(type, batches[i].process_num, b.width, b.height, inputs[i % 2], outputs[i % 2]);
+
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			if (ret != eWaifu2xError_OK)
+				forward_ret = ret;
+			else
+				forwarded_num = i + 1;
+		}
+		cond.notify_all();
+
+		if (ret != eWaifu2xError_OK)
+			break;
+	}
+
+	pack_thread.join();
+
+	if (forward_ret != eWaifu2xError_OK)
+		return forward_ret;
+
+	return pack_ret;
+}
+
+// ReconstructBlocks()ƓA摜Ŝlbg[ŇvZɎg(GPUȂfoCX̃)ɒučs
+// 摜͍ŏɈx]AubN̐؂oƌʂ̏߂͂̏ōsāAʂ̉摜͍ŌɈxo
+// outims͑ŜblockšʂŖ܂̂ƂAŜuB摜uȂReconstructBlocks()ŏ
+Waifu2x::eWaifu2xError Waifu2x::ReconstructResidentBlocks(const eNetType type, const std::vector<cv::Mat> &ims, std::vector<cv::Mat> &outims, const std::vector<stBlock> &blocks)
+{
+	const auto ret = PrepareNet(type);
+	if (ret != eWaifu2xError_OK)
+		return ret;
+
+	try
+	{
+		const auto net = type == eNetType_Noise ? net_noise : net_scale;
+		const bool isDevice = caffe::Caffe::mode() == caffe::Caffe::GPU;
+
+		const int output_padding = inner_padding + outer_padding - layer_num;
+
+		std::vector<boost::shared_ptr<Waifu2xResidentImage>> resident_ims(ims.size());
+
+		{
+			StopWatch sw(&statistics.pack_time);
+
+			for (size_t k = 0; k < ims.size(); k++)
+			{
+				if (ims[k].empty())
+					continue;
+
+				resident_ims[k].reset(new Waifu2xResidentImage(isDevice));
+				if (!resident_ims[k]->Upload(ims[k], inner_padding + outer_padding, outims[k].size()))
+				{
+					resident_ims.clear();
+					return ReconstructBlocks(type, ims, outims, blocks);
+				}
+			}
+		}
+
+		for (const auto &batch : SplitBatches(blocks))
+		{
+			const int num = batch.num;
+			const int processNum = batch.process_num;
+
+			// ~job`̃ubN͑Sē傫
+			const int BlockWidth = blocks[num].width;
+			const int BlockHeight = blocks[num].height;
+
+			const int input_block_width = BlockWidth + (inner_padding + outer_padding) * 2;
+			const int input_block_height = BlockHeight + (inner_padding + outer_padding) * 2;
+			const int output_block_width = BlockWidth + output_padding * 2;
+			const int output_block_height = BlockHeight + output_padding * 2;
+
+			const int input_block_plane_size = input_block_width * input_block_height * input_plane;
+			const int output_block_plane_size = output_block_width * output_block_height * input_plane;
+
+			auto input_blob = net->input_blobs()[0];
+
+			if (input_blob->shape(0) != processNum || input_blob->shape(2) != input_block_height || input_blob->shape(3) != input_block_width)
+				input_blob->Reshape(processNum, input_plane, input_block_height, input_block_width);
+
+			assert(input_blob->count() == input_block_plane_size * processNum);
+
+			{
+				StopWatch sw(&statistics.pack_time);
+
+				// ubN̈ʒu̓pfBO摜̏ł(w, h)ɂȂ
+				float *dst = isDevice ? input_blob->mutable_gpu_data() : input_blob->mutable_cpu_data();
+				for (int n = 0; n < processNum; n++)
+				{
+					const stBlock &b = blocks[num + n];
+					if (!resident_ims[b.image]->ExtractBlock(b.w, b.h, input_block_width, input_block_height, dst + (input_block_plane_size * n)))
+						return eWaifu2xError_FailedProcessCaffe;
+				}
+			}
+
+			const float *src = nullptr;
+
+			{
+				StopWatch sw(&statistics.forward_time);
+
+				auto out = net->ForwardPrefilled(nullptr);
+
+				auto b = out[0];
+
+				assert(b->count() == output_block_plane_size * processNum);
+
+				if (isDevice)
+				{
+					src = b->gpu_data();
+					// vZԂ𑪂悤ɌvZ̏I҂
+					CUDA_CHECK_WAIFU2X(cudaDeviceSynchronize());
+				}
+				else
+					src = b->cpu_data();
+			}
+
+			{
+				StopWatch sw(&statistics.unpack_time);
+
+				for (int n = 0; n < processNum; n++)
+				{
+					const stBlock &b = blocks[num + n];
+					if (!resident_ims[b.image]->ScatterBlock(src + (output_block_plane_size * n), output_block_width, output_block_height, output_padding,
+						b.width, b.height, b.out_w, b.out_h))
+						return eWaifu2xError_FailedProcessCaffe;
 				}
 			}
+
+			statistics.block_num += processNum;
+			statistics.batch_num++;
+			statistics.batch_capacity += batch_size;
+		}
+
+		{
+			StopWatch sw(&statistics.unpack_time);
+
+			for (size_t k = 0; k < ims.size(); k++)
+			{
+				if (resident_ims[k] && !resident_ims[k]->Download(outims[k]))
+					return eWaifu2xError_FailedProcessCaffe;
+			}
 		}
 	}
 	catch (...)
 	{
-		return eWaifu2xError_FailedProcessCaffe;
+		return GetExceptionError(eWaifu2xError_FailedProcessCaffe);
 	}
 
-	im = outim;
-
 	return eWaifu2xError_OK;
 }
 
-Waifu2x::eWaifu2xError Waifu2x::init(int argc, char** argv, const std::string &Mode, const int NoiseLevel, const double ScaleRatio, const std::string &ModelDir, const std::string &Process,
-	const int CropSize, const int BatchSize)
+// mCY1ڂ2{g܂Ƃ߂čs
+// mCY̓ubN1s()sAgɕKvȑ(Ȏт܂)ێ
+// g͑іcv::INTER_NEARESTœ{ɂ摜čč\ẑŁAmCỶ摜ŜA{ɂ摜͍Ȃ
+// ʂ͑ŜReconstructImage()ŏɏꍇƓɂȂ
+// imsCreateProcessImage()ō摜ŁA{Ɋg債摜(pfBO͎蕥)ɒuBimage_sizes{ɂȂ
+Waifu2x::eWaifu2xError Waifu2x::ReconstructNoiseScaleImage(std::vector<cv::Mat> &ims, std::vector<cv::Size_<int>> &image_sizes)
 {
 	Waifu2x::eWaifu2xError ret;
 
-	if (is_inited)
-		return eWaifu2xError_OK;
+	// 2{g1ubNŕKvɂȂ͂̉f̕(inner_padding + outer_padding)
+	const int ZoomHalo = inner_padding + outer_padding;
+	// тێ鐔(OAA)
+	const int BandRingNum = 3;
 
-	if (ScaleRatio <= 0.0)
-		return eWaifu2xError_InvalidParameter;
+	const size_t ImageNum = ims.size();
+
+	std::vector<cv::Mat> noise_ims(ImageNum);
+	std::vector<cv::Mat> scale_ims(ImageNum);
+	std::vector<cv::Size_<int>> zoom_sizes(ImageNum);
+	std::vector<std::vector<cv::Mat>> noise_bands(ImageNum);
+	std::vector<int> band_nums(ImageNum);
+	// 摜̃ubN̑傫Bт̍̓ubN̍ŁAg̉摜傫̃ubNōč\z
+	std::vector<cv::Size_<int>> tile_sizes(ImageNum);
+
+	int MaxBandNum = 0;
+	for (size_t k = 0; k < ImageNum; k++)
+	{
+		PaddingImage(ims[k], noise_ims[k]);
+		ims[k].release();
+
+		tile_sizes[k] = cv::Size_<int>(GetTileSize(noise_ims[k].cols), GetTileSize(noise_ims[k].rows));
+
+		zoom_sizes[k] = cv::Size_<int>(image_sizes[k].width * 2, image_sizes[k].height * 2);
+
+		// g̉摜̓pfBOmCỶ摜̓{̑傫(ubN̑傫̔{)ɂ
+		scale_ims[k] = cv::Mat(noise_ims[k].rows * 2, noise_ims[k].cols * 2, noise_ims[k].type());
+
+		band_nums[k] = noise_ims[k].rows / tile_sizes[k].height;
+		MaxBandNum = std::max(MaxBandNum, band_nums[k]);
+
+		for (int i = 0; i < BandRingNum; i++)
+			noise_bands[k].push_back(cv::Mat(tile_sizes[k].height, noise_ims[k].cols, noise_ims[k].type()));
+	}
+
+	// mCỶ摜bandԖڂ̑тvZ
+	const auto ReconstructNoiseBand = [&](const int band) -> eWaifu2xError
+	{
+		std::vector<cv::Mat> outims(ImageNum);
+		std::vector<stBlock> blocks;
+
+		for (size_t k = 0; k < ImageNum; k++)
+		{
+			if (band >= band_nums[k])
+				continue;
+
+			outims[k] = noise_bands[k][band % BandRingNum];
+
+			const cv::Size_<int> &tile = tile_sizes[k];
+
+			for (int w = 0; w < noise_ims[k].cols; w += tile.width)
+			{
+				stBlock b;
+				b.image = (int)k;
+				b.w = w;
+				b.h = band * tile.height;
+				b.out_w = w;
+				b.out_h = 0;
+				b.width = tile.width;
+				b.height = tile.height;
+
+				blocks.push_back(b);
+			}
+		}
+
+		std::vector<stFlatBlock> flat_blocks;
+		RemoveFlatBlocks(noise_ims, blocks, flat_blocks);
+		FillFlatBlocks(outims, flat_blocks);
+
+		if (blocks.empty())
+			return eWaifu2xError_OK;
 
+		// 傫̃ubN悤ɕבւāA~job`𖄂߂₷
+		SortBlocks(blocks);
+
+		return ReconstructBlocks(eNetType_Noise, noise_ims, outims, blocks);
+	};
+
+	ret = ReconstructNoiseBand(0);
+	if (ret != eWaifu2xError_OK)
+		return ret;
+
+	for (int band = 0; band < MaxBandNum; band++)
+	{
+		// bandg傷ɂ͎̑т̐擪Kv
+		ret = ReconstructNoiseBand(band + 1);
+		if (ret != eWaifu2xError_OK)
+			return ret;
+
+		// band{ɂ(ubN2s)A㉺ZoomHalo]ɕtččč\z
+		std::vector<cv::Mat> zoom_bands(ImageNum);
+		std::vector<stBlock> blocks;
+
+		for (size_t k = 0; k < ImageNum; k++)
+		{
+			if (band >= band_nums[k])
+				continue;
+
+			const int ZoomHeight = scale_ims[k].rows;
+			const cv::Size_<int> &tile = tile_sizes[k];
+
+			const int zt0 = band * tile.height * 2;
+			const int zt1 = std::min(zt0 + tile.height * 2, ZoomHeight);
+			if (zt0 >= zt1)
+				continue;
+
+			const int z0 = std::max(zt0 - ZoomHalo, 0);
+			const int z1 = std::min(zt1 + ZoomHalo, ZoomHeight);
+
+			zoom_bands[k] = cv::Mat(z1 - z0, scale_ims[k].cols, noise_ims[k].type());
+			CreateZoomBandImage(noise_bands[k], tile.height, zoom_sizes[k], z0, z1, zoom_bands[k]);
+
+			for (int h = zt0; h < zt1; h += tile.height)
+			{
+				for (int w = 0; w < scale_ims[k].cols; w += tile.width)
+				{
+					stBlock b;
+					b.image = (int)k;
+					b.w = w;
+					b.h = h - z0;
+					b.out_w = w;
+					b.out_h = h;
+					b.width = tile.width;
+					b.height = tile.height;
+
+					blocks.push_back(b);
+				}
+			}
+		}
+
+		std::vector<stFlatBlock> flat_blocks;
+		RemoveFlatBlocks(zoom_bands, blocks, flat_blocks);
+		FillFlatBlocks(scale_ims, flat_blocks);
+
+		if (blocks.empty())
+			continue;
+
+		SortBlocks(blocks);
+
+		ret = ReconstructBlocks(eNetType_Scale, zoom_bands, scale_ims, blocks);
+		if (ret != eWaifu2xError_OK)
+			return ret;
+	}
+
+	for (size_t k = 0; k < ImageNum; k++)
+	{
+		ims[k] = scale_ims[k](cv::Rect(offset, offset, zoom_sizes[k].width, zoom_sizes[k].height));
+		image_sizes[k] = zoom_sizes[k];
+	}
+
+	return eWaifu2xError_OK;
+}
+
+// іɕێĂmCỶ摜(band_heights)cv::INTER_NEARESTœ{Ɋg債āAg[z0, z1)sڂzoom_bandɏ
+// g̉摜(zoom_sizȇ傫)͂ݏo镔́APaddingImage()Ɠ[̉fŖ߂
+void Waifu2x::CreateZoomBandImage(const std::vector<cv::Mat> &noise_bands, const int band_height, const cv::Size_<int> &zoom_size, const int z0, const int z1, cv::Mat &zoom_band)
+{
+	StopWatch sw(&statistics.padding_time);
+
+	const int Channel = zoom_band.channels();
+	const int Width = zoom_band.cols;
+	const int BandRingNum = (int)noise_bands.size();
+
+	std::vector<int> src_x(Width);
+	for (int x = 0; x < Width; x++)
+		src_x[x] = (std::min(x, zoom_size.width - 1) / 2) * Channel;
+
+	for (int z = z0; z < z1; z++)
+	{
+		const int y = std::min(z, zoom_size.height - 1) / 2;
+		const float *src = noise_bands[(y / band_height) % BandRingNum].ptr<float>(y % band_height);
+		float *dst = zoom_band.ptr<float>(z - z0);
+
+		for (int x = 0; x < Width; x++)
+		{
+			for (int ch = 0; ch < Channel; ch++)
+				dst[x * Channel + ch] = src[src_x[x] + ch];
+		}
+	}
+}
+
+// blocksnumԖڂprocessNum̃ubNlbg[NɒʂāAʂoutimsɏ
+Waifu2x::eWaifu2xError Waifu2x::ProcessBlock(const eNetType type, const std::vector<cv::Mat> &ims, std::vector<cv::Mat> &outims, const std::vector<stBlock> &blocks, const int num, const int processNum)
+{
+	eWaifu2xError ret;
+
+	ret = PackBlocks(ims, blocks, num, processNum, input_block);
+	if (ret != eWaifu2xError_OK)
+		return ret;
+
+	ret = ForwardBlocks(type, processNum, blocks[num].width, blocks[num].height, input_block, output_block);
+	if (ret != eWaifu2xError_OK)
+		return ret;
+
+	return UnpackBlocks(outims, blocks, num, processNum, output_block);
+}
+
+// blocksnumԖڂprocessNum̃ubN؂oāAlbg[N̓͂̌`inputɏ
+Waifu2x::eWaifu2xError Waifu2x::PackBlocks(const std::vector<cv::Mat> &ims, const std::vector<stBlock> &blocks, const int num, const int processNum, float *input)
+{
 	try
 	{
-		mode = Mode;
-		noise_level = NoiseLevel;
-		scale_ratio = ScaleRatio;
-		model_dir = ModelDir;
-		process = Process;
+		// ~job`̃ubN͑Sē傫
+		const int BlockWidth = blocks[num].width;
+		const int BlockHeight = blocks[num].height;
+
+		const int input_block_width = BlockWidth + (inner_padding + outer_padding) * 2;
+		const int input_block_height = BlockHeight + (inner_padding + outer_padding) * 2;
+		const int input_block_plane_size = input_block_width * input_block_height * input_plane;
+
+		StopWatch sw(&statistics.pack_time);
+
+		for (int n = 0; n < processNum; n++)
+		{
+			const stBlock &b = blocks[num + n];
+			const cv::Mat &im = ims[b.image];
+
+			const auto Height = im.size().height;
+			const auto Width = im.size().width;
+
+			const int w = b.w;
+			const int h = b.h;
+
+			if (w + BlockWidth <= Width && h + BlockHeight <= Height)
+			{
+				int x, y;
+				x = w - inner_padding;
+				y = h - inner_padding;
+
+				int width, height;
+
+				width = BlockWidth + inner_padding * 2;
+				height = BlockHeight + inner_padding * 2;
+
+				int top, bottom, left, right;
+
+				top = outer_padding;
+				bottom = outer_padding;
+				left = outer_padding;
+				right = outer_padding;
+
+				if (x < 0)
+				{
+					left += -x;
+					width -= -x;
+					x = 0;
+				}
+
+				if (x + width > Width)
+				{
+					right += (x + width) - Width;
+					width = Width - x;
+				}
+
+				if (y < 0)
+				{
+					top += -y;
+					height -= -y;
+					y = 0;
+				}
+
+				if (y + height > Height)
+				{
+					bottom += (y + height) - Height;
+					height = Height - y;
+				}
+
+				assert(left + width + right == input_block_width);
+				assert(top + height + bottom == input_block_height);
+
+				// 摜𒆉ɃpfBOȂlbg[N̓͂ɒڏށB]cv::BORDER_REPLICATEƓ[̉fŖ߂
+				// imŉf݂镔͗]ƔFȂAinner_paddinglayer_numouter_padding1ȏȂ炻̉̕f͌ʉ摜ƂĎoɂ͉eȂ
+				PackBlock(im, x - left, y - top, cv::Rect(x, y, width, height), input_block_width, input_block_height,
+					input + (input_block_plane_size * n));
+			}
+		}
+	}
+	catch (...)
+	{
+		return GetExceptionError(eWaifu2xError_FailedProcessCaffe);
+	}
+
+	return eWaifu2xError_OK;
+}
+
+// input(o͉摜block_width x block_height̃ubNprocessNum)lbg[NɒʂāAʂoutputɏ
+Waifu2x::eWaifu2xError Waifu2x::ForwardBlocks(const eNetType type, const int processNum, const int block_width, const int block_height, float *input, float *output)
+{
+	try
+	{
+		const auto native_net = type == eNetType_Noise ? native_net_noise : native_net_scale;
+		const auto net = type == eNetType_Noise ? net_noise : net_scale;
+
+		const int output_padding = inner_padding + outer_padding - layer_num;
+
+		const int input_block_width = block_width + (inner_padding + outer_padding) * 2;
+		const int input_block_height = block_height + (inner_padding + outer_padding) * 2;
+		const int output_block_width = block_width + output_padding * 2;
+		const int output_block_height = block_height + output_padding * 2;
+
+		caffe::Blob<float> *input_blob = nullptr;
+		if (!native_net)
+		{
+			input_blob = net->input_blobs()[0];
+
+			// `ςό`(ew͌vZɓ͂ɍ킹ĕό`)
+			if (input_blob->shape(0) != processNum || input_blob->shape(2) != input_block_height || input_blob->shape(3) != input_block_width)
+				input_blob->Reshape(processNum, input_plane, input_block_height, input_block_width);
+
+			assert(input_blob->shape(1) == input_plane);
+		}
+
+		const int input_block_plane_size = input_block_width * input_block_height * input_plane;
+		const int output_block_plane_size = output_block_width * output_block_height * input_plane;
+
+		{
+			StopWatch sw(&statistics.forward_time);
+
+			if (native_net)
+			{
+				// CaffeʂɃubNɌvZ
+				for (int n = 0; n < processNum; n++)
+				{
+					native_net->Forward(input + (input_block_plane_size * n), input_block_width, input_block_height,
+						output + (output_block_plane_size * n), native_work, native_half_work);
+				}
+			}
+			else
+			{
+				assert(input_blob->count() == input_block_plane_size * processNum);
+
+				// lbg[Nɉ摜
+				input_blob->set_cpu_data(input);
+
+				// vZ
+				auto out = net->ForwardPrefilled(nullptr);
+
+				auto b = out[0];
+
+				assert(b->count() == output_block_plane_size * processNum);
+
+				const float *ptr = nullptr;
+
+				if (caffe::Caffe::mode() == caffe::Caffe::CPU)
+					ptr = b->cpu_data();
+				else
+					ptr = b->gpu_data();
+
+				caffe::caffe_copy(output_block_plane_size * processNum, ptr, output);
+			}
+		}
+
+		statistics.block_num += processNum;
+		statistics.batch_num++;
+		statistics.batch_capacity += batch_size;
+	}
+	catch (...)
+	{
+		// Caffe̒(uuGPUւ̓]vZ)GPŨmۂłȂ́ACaffeCHECK̗OɂȂAcudaError_tƂĂ͓͂Ȃ
+		// cudaMalloc()̎s͍ŌCUDÃG[ɎcĂ̂łŔf
+		if (isCuda && cudaGetLastError() == cudaErrorMemoryAllocation)
+			return eWaifu2xError_OutOfMemory;
+
+		return GetExceptionError(eWaifu2xError_FailedProcessCaffe);
+	}
+
+	return eWaifu2xError_OK;
+}
+
+// output(lbg[N̏o)processNum̃ubNAblocksnumԖڂ̈ʒuɏ]outimsɏ
+Waifu2x::eWaifu2xError Waifu2x::UnpackBlocks(std::vector<cv::Mat> &outims, const std::vector<stBlock> &blocks, const int num, const int processNum, const float *output)
+{
+	try
+	{
+		const int output_padding = inner_padding + outer_padding - layer_num;
+
+		// ~job`̃ubN͑Sē傫
+		const int BlockWidth = blocks[num].width;
+		const int BlockHeight = blocks[num].height;
+
+		const int output_block_width = BlockWidth + output_padding * 2;
+		const int output_block_height = BlockHeight + output_padding * 2;
+		const int output_block_plane_size = output_block_width * output_block_height * input_plane;
+
+		StopWatch sw(&statistics.unpack_time);
+
+		for (int n = 0; n < processNum; n++)
+		{
+			const stBlock &bl = blocks[num + n];
+			cv::Mat &outim = outims[bl.image];
+
+			float *imptr = (float *)outim.data;
+			const auto Line = outim.step1();
+
+			const int w = bl.out_w;
+			const int h = bl.out_h;
+
+			const float *fptr = output + (output_block_plane_size * n);
+
+			// ʂo͉摜ɃRs[
+			if (outim.channels() == 1)
+			{
+				for (int i = 0; i < BlockHeight; i++)
+					memcpy(imptr + (h + i) * Line + w, fptr + (i + output_padding) * output_block_width + output_padding, BlockWidth * sizeof(float));
+			}
+			else
+			{
+				const auto Channel = outim.channels();
+
+				assert(Channel <= 4);
+
+				const float *sptrs[4];
+				for (int i = 0; i < BlockHeight; i++)
+				{
+					for (int ch = 0; ch < Channel; ch++)
+						sptrs[ch] = fptr + (ch * output_block_height + i + output_padding) * output_block_width + output_padding;
+
+					Waifu2xPixelKernel::Interleave(sptrs, BlockWidth, Channel, outim.ptr<float>(h + i) + w * Channel);
+				}
+			}
+		}
+	}
+	catch (...)
+	{
+		return GetExceptionError(eWaifu2xError_FailedProcessCaffe);
+	}
+
+	return eWaifu2xError_OK;
+}
+
+Waifu2x::eWaifu2xError Waifu2x::init(int argc, char** argv, const std::string &Mode, const int NoiseLevel, const double ScaleRatio, const std::string &ModelDir, const std::string &Process,
+	const int CropSize, const int BatchSize, const InitOption &Option)
+{
+	Waifu2x::eWaifu2xError ret;
+
+	if (is_inited)
+		return eWaifu2xError_OK;
+
+	if (ScaleRatio <= 0.0)
+		return eWaifu2xError_InvalidParameter;
+
+	Waifu2xNativeNet::ePrecision precision;
+	if (!Waifu2xNativeNet::ParsePrecision(Option.native_precision, precision))
+		return eWaifu2xError_InvalidParameter;
+
+	try
+	{
+		mode = Mode;
+		noise_level = NoiseLevel;
+		scale_ratio = ScaleRatio;
+		model_dir = ModelDir;
+		process = Process;
+
+		option = Option;
+
+		inner_padding = layer_num;
+		outer_padding = 1;
+
+		original_width_height = 128 + layer_num * 2;
+
+		std::call_once(waifu2x_once_flag, [argc, argv]()
+		{
+			assert(argc >= 1);
+
+			int tmpargc = 1;
+			char* tmpargvv[] = { argv[0] };
+			char** tmpargv = tmpargvv;
+			// glog̏
+			caffe::GlobalInit(&tmpargc, &tmpargv);
+		});
+
+		const auto cuDNNCheckStartTime = std::chrono::system_clock::now();
+
+		if (process == "gpu")
+		{
+			if (can_use_CUDA() != eWaifu2xCudaError_OK)
+				return eWaifu2xError_FailedCudaCheck;
+			// cuDNNgȂcuDNNg
+			else if (can_use_cuDNN() == eWaifu2xcuDNNError_OK)
+				process = "cudnn";
+		}
+
+		const auto cuDNNCheckEndTime = std::chrono::system_clock::now();
+
+		// ̏΁Albg[ŇvZɎg̊TZ܂܂ŃubN
+		int crop = CropSize;
+		int batch = BatchSize;
+		FitBlockSize(option, process, crop, batch);
+		SetBlockSize(crop, batch);
+
+		boost::filesystem::path mode_dir_path(model_dir);
+		if (!mode_dir_path.is_absolute()) // model_dir΃pXȂ΃pXɒ
+		{
+			// ܂̓JgfBNgɂ邩T
+			mode_dir_path = boost::filesystem::absolute(model_dir);
+			if (!boost::filesystem::exists(mode_dir_path) && argc >= 1) // argv[0]st@ĈtH_𐄒肵ÃtH_ɂ邩T
+			{
+				boost::filesystem::path a0(argv[0]);
+				if (a0.is_absolute())
+					mode_dir_path = a0.branch_path() / model_dir;
+			}
+		}
+
+		if (!boost::filesystem::exists(mode_dir_path))
+			return eWaifu2xError_FailedOpenModelFile;
+
+		if (process == "cpu" || process == "native")
+		{
+			caffe::Caffe::set_mode(caffe::Caffe::CPU);
+			isCuda = false;
+		}
+		else
+		{
+			caffe::Caffe::set_mode(caffe::Caffe::GPU);
+			isCuda = true;
+		}
+
+		model_dir_path = mode_dir_path.string();
+
+		net_cache.reset(new Waifu2xNetCache(option.net_cache_num));
+
+		// Kglbg[N\zĂ(͂̃`lŌ܂)
+		// auto_scalẽmCŶ悤ɎgȂȂlbg[ŃAŏɎgɍ\z
+		if (mode == "noise" || mode == "noise_scale")
+			ret = SelectNet(eNetType_Noise, GetModelName(eNetType_Noise));
+		else if (mode == "scale" || mode == "auto_scale")
+			ret = SelectNet(eNetType_Scale, GetModelName(eNetType_Scale));
+		else
+			ret = eWaifu2xError_InvalidParameter;
+
+		if (ret != eWaifu2xError_OK)
+			return ret;
+
+		AllocBlock();
+
+		is_inited = true;
+
+		if (process == "cpu" || process == "native")
+		{
+			ret = CreateCPUWorker();
+			if (ret != eWaifu2xError_OK)
+			{
+				destroy();
+				return ret;
+			}
+		}
+	}
+	catch (...)
+	{
+		return eWaifu2xError_InvalidParameter;
+	}
+
+	return eWaifu2xError_OK;
+}
+
+// CPUŃubNɏ邽߂̃XbhƁAXbh̃lbg[N
+// Xbh0͂̃CX^XgS
+Waifu2x::eWaifu2xError Waifu2x::CreateCPUWorker()
+{
+	int thread_num = option.cpu_thread_num;
+	if (thread_num <= 0)
+		thread_num = std::max((int)std::thread::hardware_concurrency(), 1);
+
+	if (thread_num <= 1)
+		return eWaifu2xError_OK;
+
+	for (int i = 1; i < thread_num; i++)
+	{
+		boost::shared_ptr<Waifu2x> worker(new Waifu2x());
+
+		const auto ret = worker->init(*this);
+		if (ret != eWaifu2xError_OK)
+			return ret;
+
+		cpu_workers.push_back(worker);
+	}
+
+	cpu_thread_pool.reset(new Waifu2xThreadPool(thread_num));
+
+	return eWaifu2xError_OK;
+}
+
+Waifu2x::eWaifu2xError Waifu2x::init(const Waifu2x &shared)
+{
+	if (is_inited)
+		return eWaifu2xError_OK;
+
+	if (!shared.is_inited)
+		return eWaifu2xError_NotInitialized;
+
+	try
+	{
+		mode = shared.mode;
+		noise_level = shared.noise_level;
+		scale_ratio = shared.scale_ratio;
+		model_dir = shared.model_dir;
+		process = shared.process;
+
+		crop_size = shared.crop_size;
+		batch_size = shared.batch_size;
+
+		// Xbhv[͋LȂ
+		option = shared.option;
+		option.cpu_thread_num = 1;
+
+		inner_padding = shared.inner_padding;
+		outer_padding = shared.outer_padding;
+
+		output_size = shared.output_size;
+		input_block_size = shared.input_block_size;
+		original_width_height = shared.original_width_height;
+
+		output_block_size = shared.output_block_size;
+
+		input_plane = shared.input_plane;
+		isCuda = shared.isCuda;
+
+		caffe::Caffe::set_mode(isCuda ? caffe::Caffe::GPU : caffe::Caffe::CPU);
+
+		// lbg[Nshared\ẑŏɎgɋL
+		model_dir_path = shared.model_dir_path;
+		net_cache = shared.net_cache;
+
+		AllocBlock();
+
+		is_inited = true;
+	}
+	catch (...)
+	{
+		return eWaifu2xError_InvalidParameter;
+	}
+
+	return eWaifu2xError_OK;
+}
+
+// weight_netƊwKς݂̏d݂Llbg[Nnet_param(weight_net̒`)\z
+// uu(ew̓o)̓lbg[NɎ̂ŁAʁX̃XbhœɌvZł
+Waifu2x::eWaifu2xError Waifu2x::CreateSharedNet(const boost::shared_ptr<caffe::NetParameter> &net_param, const boost::shared_ptr<caffe::Net<float>> &weight_net,
+	boost::shared_ptr<caffe::Net<float>> &net)
+{
+	if (!net_param)
+		return eWaifu2xError_FailedConstructModel;
+
+	try
+	{
+		net = boost::shared_ptr<caffe::Net<float>>(new caffe::Net<float>(*net_param));
+		net->ShareTrainedLayersWith(weight_net.get());
+	}
+	catch (...)
+	{
+		return eWaifu2xError_FailedConstructModel;
+	}
+
+	return eWaifu2xError_OK;
+}
+
+// Caffẽlbg[Nݍݑw̏d݂leaky ReLǓXoāAWaifu2xNativeNet\z
+// InitOption::native_precisionfp32ȊO̎́A̐x̃lbg[NFP32̃lbg[Nœ摜vZČʂPSNRׁA
+// native_min_psnrɖȂ(ʎqɌȂd݂)FP32̃lbg[Ng
+Waifu2x::eWaifu2xError Waifu2x::CreateNativeNet(const boost::shared_ptr<caffe::Net<float>> &net, boost::shared_ptr<Waifu2xNativeNet> &native_net)
+{
+	try
+	{
+		Waifu2xNativeNet::ePrecision precision;
+		if (!Waifu2xNativeNet::ParsePrecision(option.native_precision, precision))
+			return eWaifu2xError_InvalidParameter;
+
+		boost::shared_ptr<Waifu2xNativeNet> nn(new Waifu2xNativeNet());
+		boost::shared_ptr<Waifu2xNativeNet> reduced_nn;
+		if (precision != Waifu2xNativeNet::ePrecision_FP32)
+			reduced_nn.reset(new Waifu2xNativeNet(precision));
+
+		for (const auto &layer : net->layers())
+		{
+			const std::string type = layer->type();
+			if (type == "Convolution")
+			{
+				auto &bv = layer->blobs();
+				if (bv.size() != 2)
+					return eWaifu2xError_FailedConstructModel;
+
+				auto &weight = bv[0];
+				auto &bias = bv[1];
+
+				if (weight->shape(2) != 3 || weight->shape(3) != 3 || bias->count() != weight->shape(0))
+					return eWaifu2xError_FailedConstructModel;
+
+				if (!nn->AddLayer(weight->shape(1), weight->shape(0), weight->cpu_data(), bias->cpu_data()))
+					return eWaifu2xError_FailedConstructModel;
+
+				if (reduced_nn && !reduced_nn->AddLayer(weight->shape(1), weight->shape(0), weight->cpu_data(), bias->cpu_data()))
+					return eWaifu2xError_FailedConstructModel;
+			}
+			else if (type == "ReLU")
+			{
+				const float negative_slope = layer->layer_param().relu_param().negative_slope();
+
+				if (!nn->SetReLU(negative_slope))
+					return eWaifu2xError_FailedConstructModel;
+
+				if (reduced_nn && !reduced_nn->SetReLU(negative_slope))
+					return eWaifu2xError_FailedConstructModel;
+			}
+			else if (layer->blobs().size() > 0) // d݂̎ނ̑wɂ͑ΉĂȂ
+				return eWaifu2xError_FailedConstructModel;
+		}
+
+		if (nn->layer_num() != layer_num || nn->input_channels() != input_plane || nn->output_channels() != input_plane)
+			return eWaifu2xError_FailedConstructModel;
+
+		if (reduced_nn)
+		{
+			// mFp̉摜͈l(ۂ̉摜덷傫o)B񓯂摜ɂȂ悤ɂĂ
+			const int ProbeSize = 48;
+			const int ProbeOutputSize = ProbeSize - layer_num * 2;
+
+			std::vector<float> probe(ProbeSize * ProbeSize * input_plane);
+			std::mt19937 mt(0x5eed);
+			std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+			for (auto &v : probe)
+				v = dist(mt);
+
+			std::vector<float> fp32_output(ProbeOutputSize * ProbeOutputSize * input_plane);
+			std::vector<float> reduced_output(fp32_output.size());
+			std::vector<float> work;
+			std::vector<uint16_t> half_work;
+
+			nn->Forward(probe.data(), ProbeSize, ProbeSize, fp32_output.data(), work, half_work);
+			reduced_nn->Forward(probe.data(), ProbeSize, ProbeSize, reduced_output.data(), work, half_work);
+
+			if (Waifu2xNativeNet::PSNR(fp32_output.data(), reduced_output.data(), fp32_output.size()) >= option.native_min_psnr)
+				nn = reduced_nn;
+		}
+
+		native_net = nn;
+	}
+	catch (...)
+	{
+		return eWaifu2xError_FailedConstructModel;
+	}
+
+	return eWaifu2xError_OK;
+}
+
+// typẽlbg[Ñf(JSON)̃t@C
+std::string Waifu2x::GetModelName(const eNetType type) const
+{
+	if (type == eNetType_Noise)
+		return "noise" + std::to_string(noise_level) + "_model.json";
+
+	return "scale2.0x_model.json";
+}
+
+// typẽlbg[NÃCX^XCPŨXbh̃CX^X̕ϊɎglbg[Nɂ
+// Xbh̃CX^X̃lbg[NAɏOɂ(ĂяõXbh)pӂĂ
+Waifu2x::eWaifu2xError Waifu2x::PrepareNet(const eNetType type)
+{
+	const std::string model_name = GetModelName(type);
+
+	auto ret = SelectNet(type, model_name);
+	if (ret != eWaifu2xError_OK)
+		return ret;
+
+	for (auto &worker : cpu_workers)
+	{
+		ret = worker->SelectNet(type, model_name);
+		if (ret != eWaifu2xError_OK)
+			return ret;
+	}
+
+	return eWaifu2xError_OK;
+}
+
+// model_namẽlbg[Ntypẽlbg[N(net_noisenet_scale)ɂ
+// ̃CX^XŎgƂnet_cacheoAnet_cacheɂ΍\z
+// ō\zlbg[N͏d݂lbg[Nł̂܂܌vZÃCX^X\ẑ̓uuʂɎlbg[Nďd݂L
+Waifu2x::eWaifu2xError Waifu2x::SelectNet(const eNetType type, const std::string &model_name)
+{
+	// native͐ẍႤlbg[NʂɎ
+	const std::string proc = process == "native" ? process + ":" + option.native_precision : process;
+	const std::string key = model_dir_path + "|" + model_name + "|" + proc + "|" + std::to_string(input_block_size);
+
+	auto it = net_list.begin();
+	for (; it != net_list.end(); ++it)
+	{
+		if (it->key == key)
+			break;
+	}
+
+	if (it != net_list.end())
+		net_list.splice(net_list.begin(), net_list, it);
+	else
+	{
+		const auto construct_func = [this, &model_name](Waifu2xNetCache::stEntry &entry) -> eWaifu2xError
+		{
+			const boost::filesystem::path mode_dir_path(model_dir_path);
+
+			const std::string model_path = (mode_dir_path / "srcnn.prototxt").string();
+			const std::string param_path = (mode_dir_path / model_name).string();
+
+			auto ret = ConstractNet(entry.weight_net, entry.net_param, model_path, param_path, process);
+			if (ret != eWaifu2xError_OK)
+				return ret;
+
+			if (process == "native")
+			{
+				// Caffẽlbg[Nd݂oACaffẽlbg[N͎gȂ̂Ŕj
+				ret = CreateNativeNet(entry.weight_net, entry.native_net);
+				if (ret != eWaifu2xError_OK)
+					return ret;
+
+				entry.weight_net.reset();
+				entry.net_param.reset();
+			}
+
+			return eWaifu2xError_OK;
+		};
+
+		Waifu2xNetCache::stEntry entry;
+		bool isConstructed = false;
+
+		auto ret = net_cache->get(key, construct_func, entry, isConstructed);
+		if (ret != eWaifu2xError_OK)
+			return ret;
+
+		stNet n;
+		n.key = key;
+		n.native_net = entry.native_net;
+
+		if (entry.weight_net)
+		{
+			if (isConstructed)
+				n.net = entry.weight_net;
+			else
+			{
+				ret = CreateSharedNet(entry.net_param, entry.weight_net, n.net);
+				if (ret != eWaifu2xError_OK)
+					return ret;
+			}
+		}
+
+		net_list.push_front(n);
+		while ((int)net_list.size() > std::max(option.net_cache_num, 2))
+			net_list.pop_back();
+	}
+
+	const stNet &n = net_list.front();
+	if (type == eNetType_Noise)
+	{
+		net_noise = n.net;
+		native_net_noise = n.native_net;
+	}
+	else
+	{
+		net_scale = n.net;
+		native_net_scale = n.native_net;
+	}
+
+	return eWaifu2xError_OK;
+}
+
+// lbg[Nɓo͂邽߂̍Ɨpobt@mۂ
+void Waifu2x::AllocBlock()
+{
+	const int input_block_plane_size = input_block_size * input_block_size * input_plane;
+	const int output_block_plane_size = output_block_size * output_block_size * input_plane;
+
+	if (isCuda)
+	{
+		CUDA_CHECK_WAIFU2X(cudaHostAlloc(&input_block, sizeof(float) * input_block_plane_size * batch_size, cudaHostAllocWriteCombined));
+		CUDA_CHECK_WAIFU2X(cudaHostAlloc(&output_block, sizeof(float) * output_block_plane_size * batch_size, cudaHostAllocDefault));
+		CUDA_CHECK_WAIFU2X(cudaHostAlloc(&input_block2, sizeof(float) * input_block_plane_size * batch_size, cudaHostAllocWriteCombined));
+		CUDA_CHECK_WAIFU2X(cudaHostAlloc(&output_block2, sizeof(float) * output_block_plane_size * batch_size, cudaHostAllocDefault));
+	}
+	else
+	{
+		input_block = new float[input_block_plane_size * batch_size];
+		output_block = new float[output_block_plane_size * batch_size];
+		input_block2 = new float[input_block_plane_size * batch_size];
+		output_block2 = new float[output_block_plane_size * batch_size];
+	}
+}
+
+// AllocBlock()Ŋmۂobt@
+void Waifu2x::FreeBlock()
+{
+	if (isCuda)
+	{
+		CUDA_HOST_SAFE_FREE(input_block);
+		CUDA_HOST_SAFE_FREE(output_block);
+		CUDA_HOST_SAFE_FREE(input_block2);
+		CUDA_HOST_SAFE_FREE(output_block2);
+	}
+	else
+	{
+		SAFE_DELETE_WAIFU2X(input_block);
+		SAFE_DELETE_WAIFU2X(output_block);
+		SAFE_DELETE_WAIFU2X(input_block2);
+		SAFE_DELETE_WAIFU2X(output_block2);
+	}
+}
+
+// crop_size, batch_sizeƁA猈܂ubN̑傫ݒ肷
+void Waifu2x::SetBlockSize(const int CropSize, const int BatchSize)
+{
+	crop_size = CropSize;
+	batch_size = BatchSize;
+
+	output_size = crop_size - offset * 2;
+	input_block_size = crop_size + (inner_padding + outer_padding) * 2;
+
+	output_block_size = crop_size + (inner_padding + outer_padding - layer_num) * 2;
+}
+
+// ubNiKBbatch_size2ȏȂ甼ɂA1Ȃcrop_size𔼕ɂ
+// crop_sizeMinCropSize菬Ȃ鎞͕ςfalseԂ
+bool Waifu2x::ShrinkBlockSize(int &crop_size, int &batch_size)
+{
+	if (batch_size > 1)
+	{
+		batch_size /= 2;
+		return true;
+	}
+
+	const int crop = crop_size / 2 / TileAlign * TileAlign;
+	if (crop < MinCropSize)
+		return false;
+
+	crop_size = crop;
+	return true;
+}
+
+// InitOption::host_memory_limit_mb, device_memory_limit_mb΁AEstimateNetMemory()̊TZ܂܂ShrinkBlockSize()ŏ
+// C͉摜ɂĝŁAlbg[Nɂ͂̏̔܂łgȂBŏ̑傫ł܂Ȃ΍ŏ̑傫ɂ
+// ͂̃`l̓lbg[N\z܂ŕȂ̂ŁA(3)Ōς
+void Waifu2x::FitBlockSize(const InitOption &option, const std::string &process, int &crop_size, int &batch_size)
+{
+	const uint64_t HostLimit = (uint64_t)std::max(option.host_memory_limit_mb, 0) << 20;
+	const uint64_t DeviceLimit = (uint64_t)std::max(option.device_memory_limit_mb, 0) << 20;
+
+	for (;;)
+	{
+		uint64_t host_bytes, device_bytes;
+		EstimateNetMemory(crop_size, batch_size, process, option.cpu_thread_num, 3, host_bytes, device_bytes);
+
+		const bool isHostOver = HostLimit > 0 && host_bytes > HostLimit / 2;
+		const bool isDeviceOver = DeviceLimit > 0 && device_bytes > DeviceLimit;
+		if (!isHostOver && !isDeviceOver)
+			break;
+
+		if (!ShrinkBlockSize(crop_size, batch_size))
+			break;
+	}
+}
+
+// 肸ɕϊɎsɁAubNiKĂ蒼悤ɂ
+// lbg[Ñuuƃobt@͑傫ubN̕mۂ܂܂ɂȂ̂ŁÃCX^X̃lbg[N͑IђACPŨXbh蒼
+// net_cache͑̃CX^XƋLĂ̂ł̂܂܎g(L[ɃubN̑傫Ă̂ŁAubÑlbg[N͕ʂɍ\z)
+// ȏ㏬łȂfalse
+bool Waifu2x::ReduceBlockSize()
+{
+	int crop = crop_size;
+	int batch = batch_size;
+	if (!ShrinkBlockSize(crop, batch))
+		return false;
+
+	cpu_thread_pool.reset();
+	cpu_workers.clear();
+
+	net_noise.reset();
+	net_scale.reset();
+	native_net_noise.reset();
+	native_net_scale.reset();
+	net_list.clear();
+
+	FreeBlock();
+	SetBlockSize(crop, batch);
+
+	try
+	{
+		AllocBlock();
+	}
+	catch (...)
+	{
+		return false;
+	}
+
+	if (process == "cpu" || process == "native")
+	{
+		if (CreateCPUWorker() != eWaifu2xError_OK)
+			return false;
+	}
+
+	return true;
+}
+
+void Waifu2x::destroy()
+{
+	cpu_thread_pool.reset();
+	cpu_workers.clear();
+
+	net_noise.reset();
+	net_scale.reset();
+	native_net_noise.reset();
+	native_net_scale.reset();
+	net_list.clear();
+	net_cache.reset();
+	native_work.clear();
+	native_half_work.clear();
+
+	FreeBlock();
+
+	is_inited = false;
+}
+
+Waifu2x::eWaifu2xError Waifu2x::WriteMat(const cv::Mat &im, const std::string &output_file, Statistics *stat)
+{
+	StopWatch sw(stat ? &stat->encode_time : nullptr);
+
+	const boost::filesystem::path ip(output_file);
+	const std::string ext = ip.extension().string();
+
+	const bool isJpeg = boost::iequals(ext, ".jpg") || boost::iequals(ext, ".jpeg");
+
+	if (boost::iequals(ext, ".tga"))
+	{
+		unsigned char *data = im.data;
+
+		std::vector<unsigned char> rgbimg;
+		if (im.channels() >= 3 || im.step1() != im.size().width * im.channels()) // RGBpobt@ɃRs[(邢̓pfBOƂ)
+		{
+			const auto Channel = im.channels();
+			const auto Width = im.size().width;
+			const auto Height = im.size().height;
+
+			rgbimg.resize(Width * Height * Channel);
+
+			// BGRRGBɕёւȂRs[
+			const auto Stride = Width * Channel;
+			for (int i = 0; i < Height; i++)
+				Waifu2xPixelKernel::SwapRB(im.ptr<unsigned char>(i), Width, Channel, rgbimg.data() + Stride * i);
+
+			data = rgbimg.data();
+		}
+
+		if(!stbi_write_tga(output_file.c_str(), im.size().width, im.size().height, im.channels(), data))
+			return eWaifu2xError_FailedOpenOutputFile;
+
+		return eWaifu2xError_OK;
+	}
+
+	try
+	{
+		if (cv::imwrite(output_file, im))
+			return eWaifu2xError_OK;
+
+	}
+	catch (...)
+	{
+	}
+
+	return eWaifu2xError_FailedOpenOutputFile;
+}
+
+// 摜extŎw肳ꂽ`ŃGR[hăɏ
+Waifu2x::eWaifu2xError Waifu2x::WriteMat(const cv::Mat &im, const std::string &output_ext, std::vector<unsigned char> &output_buffer, Statistics *stat)
+{
+	StopWatch sw(stat ? &stat->encode_time : nullptr);
+
+	std::string ext = output_ext;
+	if (ext.length() > 0 && ext[0] != '.')
+		ext = "." + ext;
+
+	output_buffer.clear();
+
+	if (boost::iequals(ext, ".tga"))
+	{
+		// OpenCVTGÃGR[hɑΉĂȂ̂ŎOŏ(k)
+		const auto Channel = im.channels();
+		const auto Width = im.size().width;
+		const auto Height = im.size().height;
+
+		if (Width > 0xFFFF || Height > 0xFFFF)
+			return eWaifu2xError_FailedOpenOutputFile;
+
+		unsigned char header[18] = { 0 };
+		header[2] = Channel == 1 ? 3 : 2; // 3: O[XP[, 2: tJ[
+		header[12] = Width & 0xFF;
+		header[13] = (Width >> 8) & 0xFF;
+		header[14] = Height & 0xFF;
+		header[15] = (Height >> 8) & 0xFF;
+		header[16] = Channel * 8;
+		header[17] = (Channel == 4 ? 8 : 0) | 0x20; // At@̃rbg | ㌴_
+
+		output_buffer.reserve(sizeof(header) + Width * Height * Channel);
+		output_buffer.insert(output_buffer.end(), header, header + sizeof(header));
+
+		// TGẢfBGR(A)Ȃ̂ł̂܂܃Rs[
+		const auto Stride = Width * Channel;
+		for (int i = 0; i < Height; i++)
+		{
+			const unsigned char *ptr = im.ptr<unsigned char>(i);
+			output_buffer.insert(output_buffer.end(), ptr, ptr + Stride);
+		}
+
+		return eWaifu2xError_OK;
+	}
+
+	try
+	{
+		if (cv::imencode(ext, im, output_buffer))
+			return eWaifu2xError_OK;
+	}
+	catch (...)
+	{
+	}
+
+	return eWaifu2xError_FailedOpenOutputFile;
+}
+
+// ͉摜(CV_8ŨfR[h܂܂ConvertToFloatImage()ŕϊ)lbg[Nɓ͂摜(PxRGB)
+// FϊƃZ1s܂Ƃ߂čsA͉摜Ŝ̕_̃Rs[͍Ȃ
+Waifu2x::eWaifu2xError Waifu2x::CreateProcessImage(const cv::Mat &src_image, cv::Mat &im)
+{
+	StopWatch sw(&statistics.color_convert_time);
+
+	if (!IsSourceImage(src_image))
+		return eWaifu2xError_InvalidParameter;
+
+	const stColorMatrix &m = GetColorMatrix();
+
+	im = cv::Mat(src_image.size(), CV_32FC(input_plane));
+	for (int y = 0; y < src_image.rows; y++)
+	{
+		if (src_image.depth() == CV_8U)
+			CreateProcessRow(src_image.ptr<unsigned char>(y), src_image.cols, src_image.channels(), input_plane, m, im.ptr<float>(y));
+		else
+			CreateProcessRow(src_image.ptr<float>(y), src_image.cols, src_image.channels(), input_plane, m, im.ptr<float>(y));
+	}
+
+	return eWaifu2xError_OK;
+}
+
+// CreateProcessImage()ɓn摜(CV_8ŨO[XP[ABGRABGRAACV_32FBGRABGRA)
+bool Waifu2x::IsSourceImage(const cv::Mat &src_image)
+{
+	if (src_image.empty())
+		return false;
+
+	if (src_image.depth() == CV_8U)
+		return src_image.channels() == 1 || src_image.channels() == 3 || src_image.channels() == 4;
+
+	if (src_image.depth() == CV_32F)
+		return src_image.channels() == 3 || src_image.channels() == 4;
+
+	return false;
+}
+
+// č\z摜珑ݗpCV_8Ủ摜
+// resampleRatio1łȂ΁AGetResampleInterpolation()̕ԂŊgkĂʎq
+// gk̓͂̍s͕KvɂȂ1s̂ŁAč\z傫̕_BGR(A)̉摜Ŝ͍Ȃ
+Waifu2x::eWaifu2xError Waifu2x::CreateOutputImage(const cv::Mat &src_image, const cv::Mat &im, const cv::Size_<int> &image_size, const double resampleRatio, cv::Mat &write_image)
+{
+	StopWatch sw(&statistics.merge_time);
+
+	const cv::Size_<int> ns(image_size.width * resampleRatio, image_size.height * resampleRatio);
+	if (image_size.width == ns.width && image_size.height == ns.height)
+		return CreateOutputImage(src_image, im, image_size, CV_8U, write_image);
+
+	const bool is_alpha = src_image.channels() == 4;
+	const int Channel = is_alpha ? 4 : 3;
+
+	cv::Mat color;
+	CreateColorImage(src_image, color);
+
+	boost::shared_ptr<RowResizer> color_resizer;
+	std::vector<float> color_row;
+	if (!color.empty())
+	{
+		const RowResizer::RowFunc color_func = [&color](const int y, float *buf) -> const float*
+		{
+			return color.ptr<float>(y);
+		};
+
+		color_resizer.reset(new RowResizer(color.size(), color.channels(), image_size, cv::INTER_CUBIC, color_func));
+		color_row.resize(image_size.width * color.channels());
+	}
+
+	const stColorMatrix &m = GetColorMatrix();
+
+	// č\z傫BGR(A)ysڂ
+	const RowResizer::RowFunc output_func = [&](const int y, float *buf) -> const float*
+	{
+		const float *color_ptr = nullptr;
+		if (color_resizer)
+		{
+			color_resizer->Row(y, color_row.data());
+			color_ptr = color_row.data();
+		}
+
+		CreateOutputRow(im.ptr<float>(y), input_plane, color_ptr, is_alpha, image_size.width, m, buf);
+		return buf;
+	};
+
+	RowResizer resizer(image_size, Channel, ns, GetResampleInterpolation(), output_func);
+
+	std::vector<float> row(ns.width * Channel);
+	write_image = cv::Mat(ns, CV_MAKETYPE(CV_8U, Channel));
+	for (int y = 0; y < ns.height; y++)
+	{
+		resizer.Row(y, row.data());
+
+		unsigned char *dst = write_image.ptr<unsigned char>(y);
+		for (int i = 0; i < ns.width * Channel; i++)
+			WritePixel(row[i], dst + i);
+	}
+
+	return eWaifu2xError_OK;
+}
+
+// č\z摜͉摜̐FAAt@ƍ킹āABGR(A)̉摜ɂ
+// depthCV_8UȂ珑ݗp̉摜ACV_32FȂl0.0f`1.0f͈̔͂̉摜
+// FƃAt@͓͉摜̑傫̂܂܎Ao͂1scv::INTER_CUBICƓԂŊg債āAFϊAAt@̏ZAʎqƈꏏɏ
+Waifu2x::eWaifu2xError Waifu2x::CreateOutputImage(const cv::Mat &src_image, const cv::Mat &im, const cv::Size_<int> &image_size, const int depth, cv::Mat &output_image)
+{
+	const bool is_alpha = src_image.channels() == 4;
+
+	cv::Mat color;
+	CreateColorImage(src_image, color);
+
+	boost::shared_ptr<RowResizer> resizer;
+	std::vector<float> color_row;
+	if (!color.empty())
+	{
+		const RowResizer::RowFunc color_func = [&color](const int y, float *buf) -> const float*
+		{
+			return color.ptr<float>(y);
+		};
+
+		resizer.reset(new RowResizer(color.size(), color.channels(), image_size, cv::INTER_CUBIC, color_func));
+		color_row.resize(image_size.width * color.channels());
+	}
+
+	const stColorMatrix &m = GetColorMatrix();
+
+	output_image = cv::Mat(image_size, CV_MAKETYPE(depth, is_alpha ? 4 : 3));
+	for (int y = 0; y < image_size.height; y++)
+	{
+		const float *color_ptr = nullptr;
+		if (resizer)
+		{
+			resizer->Row(y, color_row.data());
+			color_ptr = color_row.data();
+		}
+
+		if (depth == CV_8U)
+			CreateOutputRow(im.ptr<float>(y), input_plane, color_ptr, is_alpha, image_size.width, m, output_image.ptr<unsigned char>(y));
+		else
+			CreateOutputRow(im.ptr<float>(y), input_plane, color_ptr, is_alpha, image_size.width, m, output_image.ptr<float>(y));
+	}
+
+	return eWaifu2xError_OK;
+}
+
+Waifu2x::eWaifu2xError Waifu2x::waifu2x(const std::string &input_file, const std::string &output_file,
+	const waifu2xCancelFunc cancel_func)
+{
+	Waifu2x::eWaifu2xError ret;
+
+	if (!is_inited)
+		return eWaifu2xError_NotInitialized;
+
+	cv::Mat original_image;
+	ret = LoadOriginalMat(original_image, input_file, &statistics);
+	if (ret != eWaifu2xError_OK)
+		return ret;
+
+	cv::Mat write_iamge;
+	ret = waifu2x(original_image, IsJpeg(input_file), write_iamge, cancel_func);
+	if (ret != eWaifu2xError_OK)
+		return ret;
+
+	original_image.release();
+
+	ret = WriteMat(write_iamge, output_file, &statistics);
+	if (ret != eWaifu2xError_OK)
+		return ret;
+
+	write_iamge.release();
+
+	return eWaifu2xError_OK;
+}
+
+Waifu2x::eWaifu2xError Waifu2x::waifu2x(const std::vector<unsigned char> &input_buffer, const std::string &output_ext, std::vector<unsigned char> &output_buffer,
+	const waifu2xCancelFunc cancel_func)
+{
+	Waifu2x::eWaifu2xError ret;
+
+	if (!is_inited)
+		return eWaifu2xError_NotInitialized;
+
+	cv::Mat original_image;
+	ret = LoadOriginalMat(original_image, input_buffer, &statistics);
+	if (ret != eWaifu2xError_OK)
+		return ret;
+
+	cv::Mat write_image;
+	ret = waifu2x(original_image, IsJpeg(input_buffer), write_image, cancel_func);
+	if (ret != eWaifu2xError_OK)
+		return ret;
+
+	original_image.release();
+
+	return WriteMat(write_image, output_ext, output_buffer, &statistics);
+}
+
+Waifu2x::eWaifu2xError Waifu2x::waifu2x(const cv::Mat &input_image, cv::Mat &output_image,
+	const waifu2xCancelFunc cancel_func)
+{
+	Waifu2x::eWaifu2xError ret;
+
+	if (!is_inited)
+		return eWaifu2xError_NotInitialized;
+
+	if (input_image.empty())
+		return eWaifu2xError_FailedOpenInputFile;
+
+	if (input_image.depth() != CV_8U || !IsSourceImage(input_image))
+		return eWaifu2xError_InvalidParameter;
+
+	// _ɕϊɂ̂܂ܓn(lbg[Nɓ͂摜鎞1sϊ)
+	return waifu2x(input_image, false, output_image, cancel_func);
+}
+
+Waifu2x::RequestOption Waifu2x::GetRequestOption() const
+{
+	RequestOption request;
+	request.mode = mode;
+	request.noise_level = noise_level;
+	request.scale_ratio = scale_ratio;
+
+	return request;
+}
+
+// requestmode, noise_level, scale_ratiõCX^X̐ݒɂ
+// CPŨXbh̃CX^X̓lbg[NPrepareNet()Ŏ󂯎邾Ȃ̂ŁAݒςȂĂ悢
+Waifu2x::eWaifu2xError Waifu2x::SetRequestOption(const RequestOption &request)
+{
+	if (request.mode != "noise" && request.mode != "scale" && request.mode != "noise_scale" && request.mode != "auto_scale")
+		return eWaifu2xError_InvalidParameter;
+
+	if (request.scale_ratio <= 0.0)
+		return eWaifu2xError_InvalidParameter;
+
+	mode = request.mode;
+	noise_level = request.noise_level;
+	scale_ratio = request.scale_ratio;
+
+	return eWaifu2xError_OK;
+}
+
+Waifu2x::eWaifu2xError Waifu2x::preload(const RequestOption &request)
+{
+	Waifu2x::eWaifu2xError ret;
+
+	if (!is_inited)
+		return eWaifu2xError_NotInitialized;
+
+	const RequestOption prev = GetRequestOption();
+
+	ret = SetRequestOption(request);
+	if (ret != eWaifu2xError_OK)
+		return ret;
+
+	caffe::Caffe::set_mode(isCuda ? caffe::Caffe::GPU : caffe::Caffe::CPU);
+
+	if (mode == "noise" || mode == "noise_scale" || mode == "auto_scale")
+		ret = PrepareNet(eNetType_Noise);
+
+	if (ret == eWaifu2xError_OK && (mode == "scale" || mode == "noise_scale" || mode == "auto_scale"))
+		ret = PrepareNet(eNetType_Scale);
+
+	SetRequestOption(prev);
+
+	return ret;
+}
+
+Waifu2x::eWaifu2xError Waifu2x::waifu2x(const RequestOption &request, const std::vector<unsigned char> &input_buffer, std::vector<unsigned char> &output_buffer,
+	const waifu2xCancelFunc cancel_func)
+{
+	Waifu2x::eWaifu2xError ret;
+
+	if (!is_inited)
+		return eWaifu2xError_NotInitialized;
+
+	const RequestOption prev = GetRequestOption();
+
+	ret = SetRequestOption(request);
+	if (ret != eWaifu2xError_OK)
+		return ret;
+
+	ret = waifu2x(input_buffer, request.output_ext, output_buffer, cancel_func);
+
+	SetRequestOption(prev);
+
+	return ret;
+}
+
+Waifu2x::eWaifu2xError Waifu2x::waifu2x(const RequestOption &request, const cv::Mat &input_image, cv::Mat &output_image,
+	const waifu2xCancelFunc cancel_func)
+{
+	Waifu2x::eWaifu2xError ret;
+
+	if (!is_inited)
+		return eWaifu2xError_NotInitialized;
+
+	const RequestOption prev = GetRequestOption();
+
+	ret = SetRequestOption(request);
+	if (ret != eWaifu2xError_OK)
+		return ret;
+
+	ret = waifu2x(input_image, output_image, cancel_func);
+
+	SetRequestOption(prev);
+
+	return ret;
+}
+
+Waifu2x::eWaifu2xError Waifu2x::waifu2x(const cv::Mat &src_image, const bool isJpeg, cv::Mat &write_image,
+	const waifu2xCancelFunc cancel_func)
+{
+	const std::vector<cv::Mat> src_images(1, src_image);
+	const std::vector<bool> isJpegs(1, isJpeg);
+	std::vector<cv::Mat> write_images;
+
+	const auto ret = waifu2x(src_images, isJpegs, write_images, cancel_func);
+	if (ret != eWaifu2xError_OK)
+		return ret;
+
+	write_image = write_images[0];
+
+	return eWaifu2xError_OK;
+}
+
+Waifu2x::eWaifu2xError Waifu2x::waifu2x(const std::vector<cv::Mat> &src_images, const std::vector<bool> &isJpegs, std::vector<cv::Mat> &write_images,
+	const waifu2xCancelFunc cancel_func)
+{
+	Waifu2x::eWaifu2xError ret;
+
+	if (!is_inited)
+		return eWaifu2xError_NotInitialized;
+
+	if (src_images.size() != isJpegs.size())
+		return eWaifu2xError_InvalidParameter;
+
+	// Caffẽ[h̓Xbh̐ݒȂ̂ŁAinit()Ă񂾂̂ƕʂ̃XbhĂ΂ꂽ̂߂ɐݒ肵
+	caffe::Caffe::set_mode(isCuda ? caffe::Caffe::GPU : caffe::Caffe::CPU);
+
+	const size_t ImageNum = src_images.size();
+
+	// C̏đSẲ摜xɕϊƎ܂Ȃ́A1ϊA1ł܂ȂΑтɕĕϊ
+	const uint64_t Budget = GetImageMemoryBudget();
+	if (Budget != std::numeric_limits<uint64_t>::max())
+	{
+		uint64_t bytes = 0;
+		for (const auto &src_image : src_images)
+			bytes += EstimateImageMemory(src_image.size(), src_image.channels(), src_image.elemSize());
+
+		if (bytes > Budget)
+		{
+			write_images.resize(ImageNum);
+
+			if (ImageNum == 1)
+				return waifu2x(src_images[0], isJpegs[0], GetBandHeight(src_images[0], Budget), write_images[0], cancel_func);
+
+			for (size_t i = 0; i < ImageNum; i++)
+			{
+				ret = waifu2x(src_images[i], isJpegs[i], write_images[i], cancel_func);
+				if (ret != eWaifu2xError_OK)
+					return ret;
+			}
+
+			return eWaifu2xError_OK;
+		}
+	}
+
+	std::vector<cv::Mat> ims;
+	std::vector<cv::Size_<int>> image_sizes;
+	ret = ReconstructFloatImages(src_images, isJpegs, ims, image_sizes, cancel_func);
+	if (ret != eWaifu2xError_OK)
+		return ret;
+
+	statistics.image_num += ImageNum;
+
+	const double resampleRatio = GetResampleRatio();
+
+	try
+	{
+		write_images.resize(ImageNum);
+		for (size_t i = 0; i < ImageNum; i++)
+		{
+			CreateOutputImage(src_images[i], ims[i], image_sizes[i], resampleRatio, write_images[i]);
+			ims[i].release();
+		}
+	}
+	catch (...)
+	{
+		write_images.clear();
+		return GetExceptionError(eWaifu2xError_FailedProcessCaffe);
+	}
+
+	return eWaifu2xError_OK;
+}
+
+// 摜̃mCYƊg(2ׂ̂{܂)s
+// ims͍č\z摜(PxRGB)Aimage_sizes͂̑傫
+// 肸Ɏs(eWaifu2xError_OutOfMemory)AReduceBlockSize()ŃubNł蒼
+// ȊO̎s͂蒼ɂ̂܂ܕԂ
+Waifu2x::eWaifu2xError Waifu2x::ReconstructFloatImages(const std::vector<cv::Mat> &src_images, const std::vector<bool> &isJpegs, std::vector<cv::Mat> &ims,
+	std::vector<cv::Size_<int>> &image_sizes, const waifu2xCancelFunc cancel_func)
+{
+	for (;;)
+	{
+		eWaifu2xError ret;
+		try
+		{
+			ret = TryReconstructFloatImages(src_images, isJpegs, ims, image_sizes, cancel_func);
+		}
+		catch (...)
+		{
+			// CreateProcessImage()PaddingImage()ł̉摜̊mۂ̎sȂ
+			ret = GetExceptionError(eWaifu2xError_FailedProcessCaffe);
+		}
 
-		crop_size = CropSize;
-		batch_size = BatchSize;
+		if (ret != eWaifu2xError_OutOfMemory)
+			return ret;
 
-		inner_padding = layer_num;
-		outer_padding = 1;
+		// 蒼Oɓr܂ō摜Ă
+		ims.clear();
+		image_sizes.clear();
 
-		output_size = crop_size - offset * 2;
-		input_block_size = crop_size + (inner_padding + outer_padding) * 2;
-		original_width_height = 128 + layer_num * 2;
+		if (!ReduceBlockSize())
+			return ret;
+	}
+}
 
-		output_block_size = crop_size + (inner_padding + outer_padding - layer_num) * 2;
+Waifu2x::eWaifu2xError Waifu2x::TryReconstructFloatImages(const std::vector<cv::Mat> &src_images, const std::vector<bool> &isJpegs, std::vector<cv::Mat> &ims,
+	std::vector<cv::Size_<int>> &image_sizes, const waifu2xCancelFunc cancel_func)
+{
+	Waifu2x::eWaifu2xError ret;
 
-		std::call_once(waifu2x_once_flag, [argc, argv]()
-		{
-			assert(argc >= 1);
+	const size_t ImageNum = src_images.size();
 
-			int tmpargc = 1;
-			char* tmpargvv[] = { argv[0] };
-			char** tmpargv = tmpargvv;
-			// glog̏
-			caffe::GlobalInit(&tmpargc, &tmpargv);
-		});
+	ims.resize(ImageNum);
+	image_sizes.resize(ImageNum);
+	for (size_t i = 0; i < ImageNum; i++)
+	{
+		ret = CreateProcessImage(src_images[i], ims[i]);
+		if (ret != eWaifu2xError_OK)
+			return ret;
 
-		const auto cuDNNCheckStartTime = std::chrono::system_clock::now();
+		image_sizes[i] = ims[i].size();
+	}
 
-		if (process == "gpu")
-		{
-			if (can_use_CUDA() != eWaifu2xCudaError_OK)
-				return eWaifu2xError_FailedCudaCheck;
-			// cuDNNgȂcuDNNg
-			else if (can_use_cuDNN() == eWaifu2xcuDNNError_OK)
-				process = "cudnn";
-		}
+	const bool isReconstructScale = mode == "scale" || mode == "noise_scale";
 
-		const auto cuDNNCheckEndTime = std::chrono::system_clock::now();
+	const int scale2 = GetScale2();
 
-		boost::filesystem::path mode_dir_path(model_dir);
-		if (!mode_dir_path.is_absolute()) // model_dir΃pXȂ΃pXɒ
+	// noise_scale̎̓mCY1ڂ̊g܂Ƃ߂čs
+	const bool isFuseNoiseScale = mode == "noise_scale" && scale2 >= 1;
+
+	if (isFuseNoiseScale)
+	{
+		ret = ReconstructNoiseScaleImage(ims, image_sizes);
+		if (ret != eWaifu2xError_OK)
+			return ret;
+	}
+	else
+	{
+		// mCY摜W߂Ă܂Ƃ߂čč\z
+		std::vector<size_t> noise_index;
+		std::vector<cv::Mat> noise_ims;
+		for (size_t i = 0; i < ImageNum; i++)
 		{
-			// ܂̓JgfBNgɂ邩T
-			mode_dir_path = boost::filesystem::absolute(model_dir);
-			if (!boost::filesystem::exists(mode_dir_path) && argc >= 1) // argv[0]st@ĈtH_𐄒肵ÃtH_ɂ邩T
+			const bool isReconstructNoise = mode == "noise" || mode == "noise_scale" || (mode == "auto_scale" && isJpegs[i]);
+			if (isReconstructNoise)
 			{
-				boost::filesystem::path a0(argv[0]);
-				if (a0.is_absolute())
-					mode_dir_path = a0.branch_path() / model_dir;
-			}
-		}
+				cv::Mat im;
+				PaddingImage(ims[i], im);
 
-		if (!boost::filesystem::exists(mode_dir_path))
-			return eWaifu2xError_FailedOpenModelFile;
-
-		if (process == "cpu")
-		{
-			caffe::Caffe::set_mode(caffe::Caffe::CPU);
-			isCuda = false;
-		}
-		else
-		{
-			caffe::Caffe::set_mode(caffe::Caffe::GPU);
-			isCuda = true;
+				noise_index.push_back(i);
+				noise_ims.push_back(im);
+			}
 		}
 
-		if (mode == "noise" || mode == "noise_scale" || mode == "auto_scale")
+		if (noise_ims.size() > 0)
 		{
-			const std::string model_path = (mode_dir_path / "srcnn.prototxt").string();
-			const std::string param_path = (mode_dir_path / ("noise" + std::to_string(noise_level) + "_model.json")).string();
-
-			ret = ConstractNet(net_noise, model_path, param_path, process);
+			ret = ReconstructImage(eNetType_Noise, noise_ims);
 			if (ret != eWaifu2xError_OK)
 				return ret;
+
+			// pfBO蕥
+			for (size_t k = 0; k < noise_index.size(); k++)
+			{
+				const size_t i = noise_index[k];
+				ims[i] = noise_ims[k](cv::Rect(offset, offset, image_sizes[i].width, image_sizes[i].height));
+			}
 		}
+	}
+
+	if (cancel_func && cancel_func())
+		return eWaifu2xError_Cancel;
 
-		if (mode == "scale" || mode == "noise_scale" || mode == "auto_scale")
+	if (isReconstructScale)
+	{
+		for (int i = isFuseNoiseScale ? 1 : 0; i < scale2; i++)
 		{
-			const std::string model_path = (mode_dir_path / "srcnn.prototxt").string();
-			const std::string param_path = (mode_dir_path / "scale2.0x_model.json").string();
+			for (size_t k = 0; k < ImageNum; k++)
+				Zoom2xAndPaddingImage(ims[k], ims[k], image_sizes[k]);
 
-			ret = ConstractNet(net_scale, model_path, param_path, process);
+			ret = ReconstructImage(eNetType_Scale, ims);
 			if (ret != eWaifu2xError_OK)
 				return ret;
+
+			// pfBO蕥
+			for (size_t k = 0; k < ImageNum; k++)
+				ims[k] = ims[k](cv::Rect(offset, offset, image_sizes[k].width, image_sizes[k].height));
 		}
+	}
 
-		const int input_block_plane_size = input_block_size * input_block_size * input_plane;
-		const int output_block_plane_size = output_block_size * output_block_size * input_plane;
+	if (cancel_func && cancel_func())
+		return eWaifu2xError_Cancel;
 
-		if (isCuda)
-		{
-			CUDA_CHECK_WAIFU2X(cudaHostAlloc(&input_block, sizeof(float) * input_block_plane_size * batch_size, cudaHostAllocWriteCombined));
-			CUDA_CHECK_WAIFU2X(cudaHostAlloc(&dummy_data, sizeof(float) * input_block_plane_size * batch_size, cudaHostAllocWriteCombined));
-			CUDA_CHECK_WAIFU2X(cudaHostAlloc(&output_block, sizeof(float) * output_block_plane_size * batch_size, cudaHostAllocDefault));
-		}
-		else
-		{
-			input_block = new float[input_block_plane_size * batch_size];
-			dummy_data = new float[input_block_plane_size * batch_size];
-			output_block = new float[output_block_plane_size * batch_size];
-		}
+	return eWaifu2xError_OK;
+}
 
-		for (size_t i = 0; i < input_block_plane_size * batch_size; i++)
-			dummy_data[i] = 0.0f;
+// 2{̊gs
+// ʏscale_ratioȏɂȂ܂Ŋg債ĂkB2ׂ̂{őȂ̔{InitOption::max_resample_scaleȉȂA
+// scale_ratioȉ2ׂ̂{Ŏ~߂āAcԂŊg傷(Ō2{̊gȂ̂ŁA3{Ȃč\zʐς16{4{ɂȂ)
+int Waifu2x::GetScale2() const
+{
+	const int upper = (int)ceil(log2(scale_ratio));
+	const int lower = (int)floor(log2(scale_ratio));
 
-		is_inited = true;
-	}
-	catch (...)
-	{
-		return eWaifu2xError_InvalidParameter;
-	}
+	if (lower >= 1 && lower < upper && scale_ratio / std::pow(2.0, (double)lower) <= option.max_resample_scale)
+		return lower;
 
-	return eWaifu2xError_OK;
+	return upper;
 }
 
-void Waifu2x::destroy()
+// 2ׂ̂{ɂɊgk{(1菬Ώk)
+double Waifu2x::GetResampleRatio() const
 {
-	net_noise.reset();
-	net_scale.reset();
+	return scale_ratio / std::pow(2.0, (double)GetScale2());
+}
 
-	if (isCuda)
-	{
-		CUDA_HOST_SAFE_FREE(input_block);
-		CUDA_HOST_SAFE_FREE(dummy_data);
-		CUDA_HOST_SAFE_FREE(output_block);
-	}
-	else
-	{
-		SAFE_DELETE_WAIFU2X(input_block);
-		SAFE_DELETE_WAIFU2X(dummy_data);
-		SAFE_DELETE_WAIFU2X(output_block);
-	}
+// 2ׂ̂{ɂ̊gkɎg
+// kcv::INTER_LINEARAGetScale2()2ׂ̂{~߂̊gcv::INTER_CUBIC
+int Waifu2x::GetResampleInterpolation() const
+{
+	return GetResampleRatio() > 1.0 ? cv::INTER_CUBIC : cv::INTER_LINEAR;
+}
 
-	is_inited = false;
+// č\zŉ摜{ɂ邩(2ׂ̂)
+int Waifu2x::GetZoomRatio() const
+{
+	const bool isReconstructScale = mode == "scale" || mode == "noise_scale";
+	const int scale2 = GetScale2();
+
+	return isReconstructScale && scale2 > 0 ? 1 << scale2 : 1;
 }
 
-Waifu2x::eWaifu2xError Waifu2x::WriteMat(const cv::Mat &im, const std::string &output_file)
+cv::Size_<int> Waifu2x::GetOutputSize(const cv::Size_<int> &input_size) const
 {
-	const boost::filesystem::path ip(output_file);
-	const std::string ext = ip.extension().string();
+	const double resampleRatio = GetResampleRatio();
 
-	const bool isJpeg = boost::iequals(ext, ".jpg") || boost::iequals(ext, ".jpeg");
+	const int zoom = GetZoomRatio();
 
-	if (boost::iequals(ext, ".tga"))
-	{
-		unsigned char *data = im.data;
+	// CreateOutputImage()ƓvZ
+	const cv::Size_<int> image_size(input_size.width * zoom, input_size.height * zoom);
+	return cv::Size_<int>(image_size.width * resampleRatio, image_size.height * resampleRatio);
+}
 
-		std::vector<unsigned char> rgbimg;
-		if (im.channels() >= 3 || im.step1() != im.size().width * im.channels()) // RGBpobt@ɃRs[(邢̓pfBOƂ)
-		{
-			const auto Line = im.step1();
-			const auto Channel = im.channels();
-			const auto Width = im.size().width;
-			const auto Height = im.size().height;
+// тɕĕϊ鎞ɑт̏㉺ɕt]̍s(͉摜̍s)
+// lbg[N(mCYƊeiK̊g)cv::INTER_CUBICAcv::INTER_LINEAR̕ԂQƂ͈͂LƂ̂ŁAт̋ڂ͑ŜxɕϊꍇƓɂȂ
+int Waifu2x::GetBandHalo() const
+{
+	return layer_num * 2 + std::max(GetScale2(), 0) * 2 + 2;
+}
 
-			rgbimg.resize(Width * Height * Channel);
+// input_sizechannels`lA1fpixel_bytesoCg͉̓摜xɕϊ鎞ɁA摜ɎgC̊TZ(oCg)
+// ͉摜ƁAϊ̊eiK(mCYAeiK̊gAo͉摜̍쐬)œɎ摜̍v̍ől𑫂
+uint64_t Waifu2x::EstimateImageMemory(const cv::Size_<int> &input_size, const int channels, const size_t pixel_bytes) const
+{
+	const uint64_t Area = (uint64_t)input_size.width * input_size.height;
+	const uint64_t PlaneBytes = input_plane * sizeof(float);
+	const int Zoom = GetZoomRatio();
 
-			const auto Stride = Width * Channel;
-			for (int i = 0; i < Height; i++)
-				memcpy(rgbimg.data() + Stride * i, im.data + Line * i, Stride);
+	// lbg[Nɓ͂摜ƁAmCỸpfBO͂Əo
+	uint64_t peak = Area * PlaneBytes * 3;
 
-			data = rgbimg.data();
-		}
+	// 2{̊g喈ɁAO̒iK̉摜ƁAg債ăpfBO͂Əo
+	for (int z = 2; z <= Zoom; z *= 2)
+		peak = std::max(peak, Area * (z / 2) * (z / 2) * PlaneBytes + Area * z * z * PlaneBytes * 2);
 
-		if (im.channels() >= 3) // BGRRGBɕёւ
-		{
-			const auto Line = im.step1();
-			const auto Channel = im.channels();
-			const auto Width = im.size().width;
-			const auto Height = im.size().height;
+	// č\z摜A͉摜̑傫̐FƃAt@ACV_8Ȕo͉摜
+	const cv::Size_<int> ns = GetOutputSize(input_size);
+	const uint64_t ColorBytes = ((input_plane == 1 ? 2 : 0) + (channels == 4 ? 1 : 0)) * sizeof(float);
+	const uint64_t OutputBytes = (uint64_t)ns.width * ns.height * (channels == 4 ? 4 : 3);
+	peak = std::max(peak, Area * Zoom * Zoom * PlaneBytes + Area * ColorBytes + OutputBytes);
 
-			auto ptr = rgbimg.data();
-			for (int i = 0; i < Height; i++)
-			{
-				for (int j = 0; j < Width; j++)
-					std::swap(ptr[(i * Width + j) * Channel + 0], ptr[(i * Width + j) * Channel + 2]);
-			}
-		}
+	return Area * pixel_bytes + peak;
+}
 
-		if(!stbi_write_tga(output_file.c_str(), im.size().width, im.size().height, im.channels(), data))
-			return eWaifu2xError_FailedOpenOutputFile;
+// 摜Ɏg郁C̗(oCg)BInitOption::host_memory_limit_mblbg[N̊̕TZ
+// std::numeric_limits<uint64_t>::max()
+uint64_t Waifu2x::GetImageMemoryBudget() const
+{
+	if (option.host_memory_limit_mb <= 0)
+		return std::numeric_limits<uint64_t>::max();
 
-		return eWaifu2xError_OK;
-	}
+	uint64_t host_bytes, device_bytes;
+	EstimateNetMemory(crop_size, batch_size, process, option.cpu_thread_num, input_plane, host_bytes, device_bytes);
 
-	try
-	{
-		if (cv::imwrite(output_file, im))
-			return eWaifu2xError_OK;
+	const uint64_t Limit = (uint64_t)option.host_memory_limit_mb << 20;
+	return Limit > host_bytes ? Limit - host_bytes : 0;
+}
 
-	}
-	catch (...)
+// src_imageтɕĕϊ鎞ɁA摜ɎgCbudgetɎ܂т̍s(܂ȂMinBandHeight)
+// ͉摜ƁAтW߂o͉摜͑Ŝ
+int Waifu2x::GetBandHeight(const cv::Mat &src_image, const uint64_t budget) const
+{
+	const int Channel = src_image.channels();
+	const cv::Size_<int> ns = GetOutputSize(src_image.size());
+	const uint64_t FixedBytes = (uint64_t)src_image.total() * src_image.elemSize() + (uint64_t)ns.width * ns.height * (Channel == 4 ? 4 : 3);
+
+	const int BandHalo = GetBandHalo();
+
+	int band_height = src_image.rows;
+	while (band_height > MinBandHeight)
 	{
+		const cv::Size_<int> band_size(src_image.cols, std::min(band_height + BandHalo * 2, src_image.rows));
+		if (FixedBytes + EstimateImageMemory(band_size, Channel, 0) <= budget)
+			break;
+
+		band_height /= 2;
 	}
 
-	return eWaifu2xError_FailedOpenOutputFile;
+	return std::max(band_height, MinBandHeight);
 }
 
-Waifu2x::eWaifu2xError Waifu2x::waifu2x(const std::string &input_file, const std::string &output_file,
+// device_memory_limit_mb΁AReconstructResidentBlocks()imsoutims̑ŜGPŨɒuĂAlbg[N̕ƍ킹Ď܂邩
+bool Waifu2x::IsResidentInBudget(const std::vector<cv::Mat> &ims, const std::vector<cv::Mat> &outims) const
+{
+	if (!isCuda || option.device_memory_limit_mb <= 0)
+		return true;
+
+	uint64_t bytes = 0;
+	for (const auto &im : ims)
+		bytes += (uint64_t)im.total() * im.elemSize();
+	for (const auto &im : outims)
+		bytes += (uint64_t)im.total() * im.elemSize();
+
+	uint64_t host_bytes, device_bytes;
+	EstimateNetMemory(crop_size, batch_size, process, option.cpu_thread_num, input_plane, host_bytes, device_bytes);
+
+	return device_bytes + bytes <= (uint64_t)option.device_memory_limit_mb << 20;
+}
+
+Waifu2x::eWaifu2xError Waifu2x::waifu2x(const cv::Mat &input_image, const bool isJpeg, const int band_height, const waifu2xBandFunc band_func,
 	const waifu2xCancelFunc cancel_func)
 {
 	Waifu2x::eWaifu2xError ret;
@@ -1036,152 +3573,208 @@ Waifu2x::eWaifu2xError Waifu2x::waifu2x(const std::string &input_file, const std
 	if (!is_inited)
 		return eWaifu2xError_NotInitialized;
 
-	cv::Mat float_image;
-	ret = LoadMat(float_image, input_file);
-	if (ret != eWaifu2xError_OK)
-		return ret;
+	if (input_image.empty())
+		return eWaifu2xError_FailedOpenInputFile;
 
-	cv::Mat im;
-	if (input_plane == 1)
-		CreateBrightnessImage(float_image, im);
-	else
-	{
+	if (band_height <= 0 || !band_func)
+		return eWaifu2xError_InvalidParameter;
 
-		std::vector<cv::Mat> planes;
-		cv::split(float_image, planes);
+	caffe::Caffe::set_mode(isCuda ? caffe::Caffe::GPU : caffe::Caffe::CPU);
 
-		if (float_image.channels() == 4)
-			planes.resize(3);
+	const int Width = input_image.cols;
+	const int Height = input_image.rows;
 
-		// BGRRGBɂ
-		std::swap(planes[0], planes[2]);
+	const int Zoom = GetZoomRatio();
 
-		cv::merge(planes, im);
-	}
-	cv::Size_<int> image_size = im.size();
+	const cv::Size_<int> zoom_size(Width * Zoom, Height * Zoom);
+	const cv::Size_<int> ns = GetOutputSize(input_image.size());
+	const bool isResample = zoom_size.width != ns.width || zoom_size.height != ns.height;
 
-	const boost::filesystem::path ip(input_file);
-	const boost::filesystem::path ipext(ip.extension());
+	// cv::resize()ƓA傫̔gkƂ
+	const double sx = (double)ns.width / zoom_size.width;
+	const double sy = (double)ns.height / zoom_size.height;
 
-	const bool isJpeg = boost::iequals(ipext.string(), ".jpg") || boost::iequals(ipext.string(), ".jpeg");
+	const int BandHalo = GetBandHalo();
 
-	const bool isReconstructNoise = mode == "noise" || mode == "noise_scale" || (mode == "auto_scale" && isJpeg);
-	const bool isReconstructScale = mode == "scale" || mode == "noise_scale";
+	// ͉摜rsڂn܂т́Ao͉摜̊Jns
+	const auto OutputRow = [&](const int r) -> int
+	{
+		if (r >= Height)
+			return ns.height;
+
+		if (!isResample)
+			return r * Zoom;
+
+		const int j = (int)ceil((r * Zoom + 0.5) * sy - 0.5);
+		return std::min(std::max(j, 0), ns.height);
+	};
 
-	if (isReconstructNoise)
+	const std::vector<bool> isJpegs(1, isJpeg);
+
+	for (int r0 = 0; r0 < Height; r0 += band_height)
 	{
-		PaddingImage(im, im);
+		const int r1 = std::min(r0 + band_height, Height);
+		const int a0 = std::max(r0 - BandHalo, 0);
+		const int a1 = std::min(r1 + BandHalo, Height);
+
+		const int j0 = OutputRow(r0);
+		const int j1 = OutputRow(r1);
+		if (j0 >= j1)
+			continue;
 
-		ret = ReconstructImage(net_noise, im);
+		// т̓fR[h܂(CV_8U)nA_̉摜̓lbg[Nɓ͂镪
+		const std::vector<cv::Mat> src_images(1, input_image.rowRange(a0, a1));
+
+		std::vector<cv::Mat> ims;
+		std::vector<cv::Size_<int>> image_sizes;
+		ret = ReconstructFloatImages(src_images, isJpegs, ims, image_sizes, cancel_func);
 		if (ret != eWaifu2xError_OK)
 			return ret;
 
-		// pfBO蕥
-		im = im(cv::Rect(offset, offset, image_size.width, image_size.height));
-	}
+		cv::Mat write_band;
+		{
+			StopWatch sw(&statistics.merge_time);
 
-	if (cancel_func && cancel_func())
-		return eWaifu2xError_Cancel;
+			if (isResample)
+			{
+				cv::Mat process_image;
+				CreateOutputImage(src_images[0], ims[0], image_sizes[0], CV_32F, process_image);
+				ims.clear();
 
-	const int scale2 = ceil(log2(scale_ratio));
-	const double shrinkRatio = scale_ratio / std::pow(2.0, (double)scale2);
+				// т̒ł̈ʒuł͂Ȃ摜Ŝł̈ʒuŁAcv::resize()ƓW̑ΉɂȂ悤Ɋgk
+				const cv::Mat m = (cv::Mat_<double>(2, 3) <<
+					1.0 / sx, 0.0, 0.5 / sx - 0.5,
+					0.0, 1.0 / sy, (j0 + 0.5) / sy - 0.5 - a0 * Zoom);
 
-	if (isReconstructScale)
-	{
-		bool isError = false;
-		for (int i = 0; i < scale2; i++)
-		{
-			Zoom2xAndPaddingImage(im, im, image_size);
+				cv::Mat band;
+				cv::warpAffine(process_image, band, m, cv::Size(ns.width, j1 - j0), GetResampleInterpolation() | cv::WARP_INVERSE_MAP, cv::BORDER_REPLICATE);
 
-			ret = ReconstructImage(net_scale, im);
-			if (ret != eWaifu2xError_OK)
-				return ret;
+				band.convertTo(write_band, CV_8U, 255.0);
+			}
+			else
+			{
+				cv::Mat process_image;
+				CreateOutputImage(src_images[0], ims[0], image_sizes[0], CV_8U, process_image);
+				ims.clear();
 
-			// pfBO蕥
-			im = im(cv::Rect(offset, offset, image_size.width, image_size.height));
+				write_band = process_image.rowRange((r0 - a0) * Zoom, (r1 - a0) * Zoom);
+			}
 		}
-	}
 
-	if (cancel_func && cancel_func())
-		return eWaifu2xError_Cancel;
+		if (!band_func(write_band, j0))
+			return eWaifu2xError_Cancel;
 
-	cv::Mat process_image;
-	if (input_plane == 1)
-	{
-		// č\zPx摜CreateZoomColorImage()ō쐬F}[WĒʏ̉摜ɕϊA
+		if (cancel_func && cancel_func())
+			return eWaifu2xError_Cancel;
+	}
 
-		std::vector<cv::Mat> color_planes;
-		CreateZoomColorImage(float_image, image_size, color_planes);
+	statistics.image_num++;
 
-		float_image.release();
+	return eWaifu2xError_OK;
+}
 
-		color_planes[0] = im;
-		im.release();
+Waifu2x::eWaifu2xError Waifu2x::waifu2x(const cv::Mat &input_image, const bool isJpeg, const int band_height, cv::Mat &output_image,
+	const waifu2xCancelFunc cancel_func)
+{
+	if (!is_inited)
+		return eWaifu2xError_NotInitialized;
 
-		cv::Mat converted_image;
-		cv::merge(color_planes, converted_image);
-		color_planes.clear();
+	if (input_image.empty())
+		return eWaifu2xError_FailedOpenInputFile;
 
-		cv::cvtColor(converted_image, process_image, ConvertInverseMode);
-		converted_image.release();
-	}
-	else
+	cv::Mat out;
+	const auto band_func = [this, &out, &input_image](const cv::Mat &write_band, const int y)
 	{
-		std::vector<cv::Mat> planes;
-		cv::split(im, planes);
-
-		// RGBBGRɒ
-		std::swap(planes[0], planes[2]);
+		if (out.empty())
+			out = cv::Mat(GetOutputSize(input_image.size()), write_band.type());
 
-		cv::merge(planes, process_image);
-	}
+		write_band.copyTo(out.rowRange(y, y + write_band.rows));
 
-	cv::Mat alpha;
-	if (float_image.channels() == 4)
-	{
-		std::vector<cv::Mat> planes;
-		cv::split(float_image, planes);
-		alpha = planes[3];
+		return true;
+	};
 
-		cv::resize(alpha, alpha, image_size, 0.0, 0.0, cv::INTER_CUBIC);
-	}
+	const auto ret = waifu2x(input_image, isJpeg, band_height, band_func, cancel_func);
+	if (ret != eWaifu2xError_OK)
+		return ret;
 
-	// At@`lAAt@tăJ[At@̉e𔲂
-	if (!alpha.empty())
-	{
-		std::vector<cv::Mat> planes;
-		cv::split(process_image, planes);
-		process_image.release();
+	output_image = out;
 
-		planes.push_back(alpha);
+	return eWaifu2xError_OK;
+}
 
-		cv::Mat w2 = planes[3];
+void Waifu2x::EstimateNetMemory(const int crop_size, const int batch_size, const std::string &process, const int thread_num, const int input_plane,
+	uint64_t &host_bytes, uint64_t &device_bytes)
+{
+	const uint64_t InputBlockSize = crop_size + (layer_num + 1) * 2;
+	const uint64_t OutputBlockSize = crop_size + 2;
 
-		planes[0] = (planes[0]).mul(1.0 / w2);
-		planes[1] = (planes[1]).mul(1.0 / w2);
-		planes[2] = (planes[2]).mul(1.0 / w2);
+	// AllocBlock()Ŋmۂ2g̓o̓obt@
+	const uint64_t BlockBytes = (InputBlockSize * InputBlockSize + OutputBlockSize * OutputBlockSize) * input_plane * batch_size * sizeof(float) * 2;
 
-		cv::merge(planes, process_image);
+	uint64_t NetBytes = 0;
+	if (process == "native")
+	{
+		// Waifu2xNativeNet̍Ɨpobt@(ubNɌvẐbatch_sizeɂȂ)
+		NetBytes = InputBlockSize * InputBlockSize * layer_output_planes[layer_num - 2] * sizeof(float) * 2;
 	}
+	else
+	{
+		// ͂Ɗew̏o͂̃uuAewim2col̃obt@(摜1)
+		NetBytes = InputBlockSize * InputBlockSize * input_plane * batch_size * sizeof(float);
 
-	const cv::Size_<int> ns(image_size.width * shrinkRatio, image_size.height * shrinkRatio);
-	if (image_size.width != ns.width || image_size.height != ns.height)
-		cv::resize(process_image, process_image, ns, 0.0, 0.0, cv::INTER_LINEAR);
+		int in_plane = input_plane;
+		for (int i = 0; i < layer_num; i++)
+		{
+			const uint64_t out_size = InputBlockSize - (i + 1) * 2;
+			const int out_plane = i < layer_num - 1 ? layer_output_planes[i] : input_plane;
 
-	cv::Mat write_iamge;
-	process_image.convertTo(write_iamge, CV_8U, 255.0);
-	process_image.release();
+			NetBytes += out_size * out_size * out_plane * batch_size * sizeof(float);
+			NetBytes += out_size * out_size * in_plane * 9 * sizeof(float);
 
-	ret = WriteMat(write_iamge, output_file);
-	if (ret != eWaifu2xError_OK)
-		return ret;
+			in_plane = out_plane;
+		}
+	}
 
-	write_iamge.release();
+	int ThreadNum = 1;
+	if (process == "cpu" || process == "native")
+		ThreadNum = thread_num > 0 ? thread_num : std::max((int)std::thread::hardware_concurrency(), 1);
 
-	return eWaifu2xError_OK;
+	host_bytes = BlockBytes * ThreadNum;
+	device_bytes = 0;
+
+	if (process == "cpu" || process == "native")
+		host_bytes += NetBytes * ThreadNum;
+	else
+		device_bytes = NetBytes;
 }
 
 const std::string& Waifu2x::used_process() const
 {
 	return process;
 }
+
+int Waifu2x::used_crop_size() const
+{
+	return crop_size;
+}
+
+int Waifu2x::used_batch_size() const
+{
+	return batch_size;
+}
+
+Waifu2x::Statistics Waifu2x::GetStatistics() const
+{
+	Statistics stat = statistics;
+	for (const auto &worker : cpu_workers)
+		stat += worker->statistics;
+
+	return stat;
+}
+
+void Waifu2x::ResetStatistics()
+{
+	statistics = Statistics();
+	for (auto &worker : cpu_workers)
+		worker->statistics = Statistics();
+}
@@ -3,10 +3,12 @@
 #include <stdint.h>
 #include <string>
 #include <vector>
+#include <list>
 #include <utility>
 #include <functional>
 #include <boost/shared_ptr.hpp>
 #include <opencv2/opencv.hpp>
+#include "model_cache.h"
 
 
 namespace caffe
@@ -16,6 +18,10 @@ namespace caffe
 	class NetParameter;
 };
 
+class Waifu2xThreadPool;
+class Waifu2xNativeNet;
+class Waifu2xNetCache;
+
 class Waifu2x
 {
 public:
@@ -32,6 +38,7 @@ public:
 		eWaifu2xError_FailedConstructModel,
 		eWaifu2xError_FailedProcessCaffe,
 		eWaifu2xError_FailedCudaCheck,
+		eWaifu2xError_OutOfMemory,
 	};
 
 	enum eWaifu2xCudaError
@@ -50,11 +57,145 @@ public:
 	};
 
 	typedef std::function<bool()> waifu2xCancelFunc;
+	// тɕĕϊ鎞ɁAϊ(CV_8U)Əo͉摜ł̑т̊Jns󂯎BfalseԂƕϊ𒆒f
+	typedef std::function<bool(const cv::Mat &write_band, const int y)> waifu2xBandFunc;
+
+	// init()̒ǉݒ
+	struct InitOption
+	{
+		// processcpunative̎ɃubNɏXbh̐(0ȂCPU̘_RA)
+		int cpu_thread_num;
+		// 摜Ŝlbg[ŇvZɎg(GPUȂfoCX̃)ɒuāAubN̐؂oƌʂ̏߂̏ōs
+		// processcpu͓̎zXg̃ōs(GPU̖ł̊mFp)Bnativecpu_thread_num2ȏ͎̎gȂ
+		bool device_resident;
+		// f̏d݂̃LbVutH_(Ȃ烂fƓtH_B߂ȂΈꎞtH_)
+		std::string model_cache_dir;
+		// \zlbg[NێĂ(ŋߎĝc)
+		// lbg[N͍ŏɎgɍ\ẑŁAnoise_levelmodeςĕϊ鎞ɕێ鐔𑝂₷ƍ\zɍς
+		int net_cache_num;
+
+		// ʂɉe͈(ubNƎinner_padding܂)̉fRȃubŃAlbg[Nɒʂɂ̐FŖ߂
+		// Fœhꂽ⊮Sɓȕ摜(XvCgȂ)őȂBlbg[NɒʂꍇƂ͂킸ɈႤʂɂȂ
+		bool skip_flat_block;
+		// RƂ݂Ȃ`l̍őlƍŏl̍(0`255̒l)
+		float flat_block_tolerance;
+
+		// processnative̎̌vZ̐x(fp32, fp16, int8)
+		// fp16͏d݂ƑẘԂ̉摜𔼐x_ŁAint8͏d݂8bit(o̓`l̃XP[t)ŎBϘa͂ǂfloatŌvZ
+		std::string native_precision;
+		// native_precisionfp32ȊO̎ɁAFP32ŌvZʂƂPSNR(dB)ꖢɂȂ郂fFP32ŌvZ
+		double native_min_psnr;
+
+		// scale_ratio2ׂ̂łȂɁAscale_ratioȉ2ׂ̂{܂ōč\zĎccv::INTER_CUBICŊg債Ă悢Ac̔{̏
+		// 1.0(ftHg)Ȃscale_ratioȏ2ׂ̂{܂ōč\zĂkB2.0ȂɈȉ2ׂ̂{Ŏ~߂
+		// 3{Ȃ4{܂ōč\zďk2{܂ōč\z1.5{ɕԂ̂ŁAč\zʐς1/4ɂȂ(Ō̊gԂōsA掿͗)
+		double max_resample_scale;
+
+		// CGPŨ̎gpʂ̏(MB)B0Ȃ琧Ȃ
+		// init()Ńlbg[ŇvZɎg̊TZ(EstimateNetMemory())܂悤crop_size, batch_sizeA
+		// ϊ摜C̎cɎ܂Ȃ͂܂Ƃ߂1Ał܂ȂΑтɕĕϊ
+		// (d݂̕ƁAĂяo摜͊̕܂܂Ȃ̂ŁA]TĎw肷邱)
+		int host_memory_limit_mb;
+		int device_memory_limit_mb;
+
+		InitOption() : cpu_thread_num(1), device_resident(false), net_cache_num(4), skip_flat_block(false), flat_block_tolerance(1.0f),
+			native_precision("fp32"), native_min_psnr(30.0), max_resample_scale(1.0), host_memory_limit_mb(0), device_memory_limit_mb(0)
+		{
+		}
+	};
+
+	// ϊ̐ݒBinit()Ŏw肵mode, noise_level, scale_ratiȏɎg
+	struct RequestOption
+	{
+		// noise or scale or noise_scale or auto_scale
+		std::string mode;
+		int noise_level;
+		double scale_ratio;
+		// ̉摜t@Cϊ鎞ɁAʂGR[h`(".png"Ȃǂ̊gq)
+		std::string output_ext;
+
+		RequestOption() : mode("noise_scale"), noise_level(1), scale_ratio(2.0), output_ext(".png")
+		{
+		}
+	};
+
+	// ϊ̊eiKɂ(b)ƏubN̐Ȃǂ̓v
+	// ̃XbhŏiK(pack, forward, unpack)̎Ԃ͊eXbh̎Ԃ̍v
+	struct Statistics
+	{
+		double decode_time;			// 摜̃fR[h
+		double color_convert_time;	// _ւ̕ϊƁAlbg[Nɓ͂摜(PxRGB)̍쐬
+		double padding_time;		// pfBOcv::INTER_NEARESTł2{g
+		double pack_time;			// ubN̐؂oƃlbg[N̓͂ւ̕בւ
+		double forward_time;		// lbg[ŇvZ
+		double unpack_time;			// lbg[N̏o͂̉摜ւ̏߂
+		double merge_time;			// FAAt@Ƃ̍8bitւ̕ϊ
+		double encode_time;			// 摜̃GR[h
+
+		uint64_t image_num;			// ϊ摜̐
+		uint64_t block_num;			// lbg[NɒʂubN̐
+		uint64_t batch_num;			// lbg[NvZ
+		uint64_t batch_capacity;	// lbg[NvZbatch_size̍v(block_num / batch_capacity~job`̏[U)
+		uint64_t skip_block_num;	// RȂ̂Ńlbg[Nɒʂɖ߂ubN̐
+
+		Statistics();
+		Statistics& operator+=(const Statistics &s);
+	};
+
+private:
+	enum eNetType
+	{
+		eNetType_Noise,
+		eNetType_Scale,
+	};
+
+	// ReconstructImage()ŏubN
+	struct stBlock
+	{
+		int image;
+		// ͉摜̈ʒu
+		int w;
+		int h;
+		// o͉摜̈ʒu
+		int out_w;
+		int out_h;
+		// o͉摜ɏޑ傫(lbg[Nɓ͎͂̂͂inner_padding + outer_paddingt傫)
+		int width;
+		int height;
+	};
+
+	// 傫̃ubN܂Ƃ߂~job`
+	struct stBatch
+	{
+		// 擪̃ubN̔ԍ
+		int num;
+		// ubN̐(batch_sizeȉ)
+		int process_num;
+	};
+
+	// lbg[Nɒʂɖ߂ubN
+	struct stFlatBlock
+	{
+		stBlock block;
+		// ߂l(lbg[Nɓ͂摜Ɠ`l̏)
+		cv::Scalar value;
+	};
+
+	// ̃CX^XϊɎglbg[N
+	struct stNet
+	{
+		// Waifu2xNetCacheł̃L[
+		std::string key;
+		// Caffẽlbg[N(processnative͎̎Ȃ)Buu̓CX^XɎ
+		boost::shared_ptr<caffe::Net<float>> net;
+		// processnative̎Ɏglbg[NBd݂Ȃ̂ŕ̃CX^XŋL
+		boost::shared_ptr<Waifu2xNativeNet> native_net;
+	};
 
 private:
 	bool is_inited;
 
-	// xɏ摜̕
+	// xɏ摜̕(̍őlBۂ̕GetTileSize()ŉ摜̑傫ɍ킹Č߂)
 	int crop_size;
 	// xɉubN邩
 	int batch_size;
@@ -74,6 +215,14 @@ private:
 	std::string model_dir;
 	std::string process;
 
+	// model_dir΃pXɒ
+	std::string model_dir_path;
+
+	InitOption option;
+
+	// ̃CX^Xŏ̓v
+	Statistics statistics;
+
 	int inner_padding;
 	int outer_padding;
 
@@ -83,25 +232,89 @@ private:
 
 	bool isCuda;
 
+	// \zlbg[N(wKς݂̏d݂)Binit(const Waifu2x &)ŏCX^XƋL
+	boost::shared_ptr<Waifu2xNetCache> net_cache;
+	// ̃CX^XŎglbg[N(ŋߎg)
+	std::list<stNet> net_list;
+
+	// ϊɎglbg[NBPrepareNet()net_list̒I
 	boost::shared_ptr<caffe::Net<float>> net_noise;
 	boost::shared_ptr<caffe::Net<float>> net_scale;
+	boost::shared_ptr<Waifu2xNativeNet> native_net_noise;
+	boost::shared_ptr<Waifu2xNativeNet> native_net_scale;
+	// Waifu2xNativeNet̍Ɨpobt@
+	std::vector<float> native_work;
+	std::vector<uint16_t> native_half_work;
 
 	float *input_block;
-	float *dummy_data;
 	float *output_block;
+	// ReconstructPipelinedBlocks()ŌvZɎ̃~job`؂oĂ߂2gڂ̓o̓obt@
+	float *input_block2;
+	float *output_block2;
+
+	// CPUŃubNɏXbhƁAXbh1ȍ~gCX^X(d݂͂̃CX^XƋL)
+	boost::shared_ptr<Waifu2xThreadPool> cpu_thread_pool;
+	std::vector<boost::shared_ptr<Waifu2x>> cpu_workers;
 
 private:
-	static eWaifu2xError LoadMat(cv::Mat &float_image, const std::string &input_file);
 	static eWaifu2xError LoadMatBySTBI(cv::Mat &float_image, const std::string &input_file);
-	eWaifu2xError CreateBrightnessImage(const cv::Mat &float_image, cv::Mat &im);
+	static eWaifu2xError LoadMatBySTBI(cv::Mat &float_image, const std::vector<unsigned char> &input_buffer);
+	static eWaifu2xError CreateMatFromSTBI(cv::Mat &float_image, const unsigned char *data, const int x, const int y, const int comp);
+	static eWaifu2xError ConvertToFloatImage(const cv::Mat &original_image, cv::Mat &float_image, Statistics *stat = nullptr);
+	int GetTileSize(const int length) const;
 	eWaifu2xError PaddingImage(const cv::Mat &input, cv::Mat &output);
 	eWaifu2xError Zoom2xAndPaddingImage(const cv::Mat &input, cv::Mat &output, cv::Size_<int> &zoom_size);
-	eWaifu2xError CreateZoomColorImage(const cv::Mat &float_image, const cv::Size_<int> &zoom_size, std::vector<cv::Mat> &cubic_planes);
-	eWaifu2xError ConstractNet(boost::shared_ptr<caffe::Net<float>> &net, const std::string &model_path, const std::string &param_path, const std::string &process);
-	eWaifu2xError LoadParameterFromJson(boost::shared_ptr<caffe::Net<float>> &net, const std::string &model_path, const std::string &param_path);
+	eWaifu2xError CreateColorImage(const cv::Mat &src_image, cv::Mat &color);
+	eWaifu2xError ConstractNet(boost::shared_ptr<caffe::Net<float>> &net, boost::shared_ptr<caffe::NetParameter> &net_param, const std::string &model_path,
+		const std::string &param_path, const std::string &process);
+	std::vector<std::string> GetModelCacheDirs(const std::string &param_path) const;
+	eWaifu2xError SetWeights(boost::shared_ptr<caffe::Net<float>> &net, const std::vector<Waifu2xModelCache::stLayer> &layers);
+	eWaifu2xError LoadParameterFromJson(boost::shared_ptr<caffe::Net<float>> &net, const std::string &param_path, const std::vector<std::string> &cache_dirs);
 	eWaifu2xError SetParameter(caffe::NetParameter &param) const;
-	eWaifu2xError ReconstructImage(boost::shared_ptr<caffe::Net<float>> net, cv::Mat &im);
-	eWaifu2xError WriteMat(const cv::Mat &im, const std::string &output_file);
+	eWaifu2xError CreateSharedNet(const boost::shared_ptr<caffe::NetParameter> &net_param, const boost::shared_ptr<caffe::Net<float>> &weight_net,
+		boost::shared_ptr<caffe::Net<float>> &net);
+	eWaifu2xError CreateNativeNet(const boost::shared_ptr<caffe::Net<float>> &net, boost::shared_ptr<Waifu2xNativeNet> &native_net);
+	std::string GetModelName(const eNetType type) const;
+	eWaifu2xError PrepareNet(const eNetType type);
+	eWaifu2xError SelectNet(const eNetType type, const std::string &model_name);
+	void AllocBlock();
+	void FreeBlock();
+	void SetBlockSize(const int CropSize, const int BatchSize);
+	static bool ShrinkBlockSize(int &crop_size, int &batch_size);
+	bool ReduceBlockSize();
+	uint64_t GetImageMemoryBudget() const;
+	int GetBandHalo() const;
+	int GetBandHeight(const cv::Mat &src_image, const uint64_t budget) const;
+	bool IsResidentInBudget(const std::vector<cv::Mat> &ims, const std::vector<cv::Mat> &outims) const;
+	eWaifu2xError ReconstructImage(const eNetType type, cv::Mat &im);
+	eWaifu2xError ReconstructImage(const eNetType type, std::vector<cv::Mat> &ims);
+	static void SortBlocks(std::vector<stBlock> &blocks);
+	std::vector<stBatch> SplitBatches(const std::vector<stBlock> &blocks) const;
+	void RemoveFlatBlocks(const std::vector<cv::Mat> &ims, std::vector<stBlock> &blocks, std::vector<stFlatBlock> &flat_blocks);
+	void FillFlatBlocks(std::vector<cv::Mat> &outims, const std::vector<stFlatBlock> &flat_blocks);
+	eWaifu2xError ReconstructBlocks(const eNetType type, const std::vector<cv::Mat> &ims, std::vector<cv::Mat> &outims, const std::vector<stBlock> &blocks);
+	eWaifu2xError ReconstructPipelinedBlocks(const eNetType type, const std::vector<cv::Mat> &ims, std::vector<cv::Mat> &outims, const std::vector<stBlock> &blocks);
+	eWaifu2xError ReconstructResidentBlocks(const eNetType type, const std::vector<cv::Mat> &ims, std::vector<cv::Mat> &outims, const std::vector<stBlock> &blocks);
+	eWaifu2xError ReconstructNoiseScaleImage(std::vector<cv::Mat> &ims, std::vector<cv::Size_<int>> &image_sizes);
+	void CreateZoomBandImage(const std::vector<cv::Mat> &noise_bands, const int band_height, const cv::Size_<int> &zoom_size, const int z0, const int z1, cv::Mat &zoom_band);
+	eWaifu2xError ProcessBlock(const eNetType type, const std::vector<cv::Mat> &ims, std::vector<cv::Mat> &outims, const std::vector<stBlock> &blocks, const int num, const int processNum);
+	eWaifu2xError PackBlocks(const std::vector<cv::Mat> &ims, const std::vector<stBlock> &blocks, const int num, const int processNum, float *input);
+	eWaifu2xError ForwardBlocks(const eNetType type, const int processNum, const int block_width, const int block_height, float *input, float *output);
+	eWaifu2xError UnpackBlocks(std::vector<cv::Mat> &outims, const std::vector<stBlock> &blocks, const int num, const int processNum, const float *output);
+	eWaifu2xError CreateCPUWorker();
+	static bool IsSourceImage(const cv::Mat &src_image);
+	eWaifu2xError CreateProcessImage(const cv::Mat &src_image, cv::Mat &im);
+	eWaifu2xError CreateOutputImage(const cv::Mat &src_image, const cv::Mat &im, const cv::Size_<int> &image_size, const double resampleRatio, cv::Mat &write_image);
+	eWaifu2xError CreateOutputImage(const cv::Mat &src_image, const cv::Mat &im, const cv::Size_<int> &image_size, const int depth, cv::Mat &output_image);
+	eWaifu2xError SetRequestOption(const RequestOption &request);
+	eWaifu2xError ReconstructFloatImages(const std::vector<cv::Mat> &src_images, const std::vector<bool> &isJpegs, std::vector<cv::Mat> &ims,
+		std::vector<cv::Size_<int>> &image_sizes, const waifu2xCancelFunc cancel_func);
+	eWaifu2xError TryReconstructFloatImages(const std::vector<cv::Mat> &src_images, const std::vector<bool> &isJpegs, std::vector<cv::Mat> &ims,
+		std::vector<cv::Size_<int>> &image_sizes, const waifu2xCancelFunc cancel_func);
+	int GetScale2() const;
+	double GetResampleRatio() const;
+	int GetResampleInterpolation() const;
+	int GetZoomRatio() const;
 
 public:
 	Waifu2x();
@@ -111,16 +324,100 @@ public:
 	static eWaifu2xCudaError can_use_CUDA();
 
 	// mode: noise or scale or noise_scale or auto_scale
-	// process: cpu or gpu or cudnn
+	// process: cpu or gpu or cudnn or native
 	eWaifu2xError init(int argc, char** argv, const std::string &mode, const int noise_level, const double scale_ratio, const std::string &model_dir, const std::string &process,
-		const int crop_size = 128, const int batch_size = 1);
+		const int crop_size = 128, const int batch_size = 1, const InitOption &option = InitOption());
+
+	// ς݂sharedƊwKς݂̏d݂LďBݒsharedƓɂȂ
+	// d݂ǂݍݒAɂȂ̂ŁAϊXbhɃCX^X鎞Ɏg
+	// (̃CX^X𓯎ɕ̃XbhgƂ͏oȂ)
+	eWaifu2xError init(const Waifu2x &shared);
 
 	void destroy();
 
 	eWaifu2xError waifu2x(const std::string &input_file, const std::string &output_file,
 		const waifu2xCancelFunc cancel_func = nullptr);
 
+	// ̃GR[hꂽ摜(摜t@C̒g)ϊAoutput_ext(".png"Ȃ)̌`ŃGR[hʂoutput_bufferɕԂ
+	// auto_scale̎͐擪̃}[J[JPEG肷
+	eWaifu2xError waifu2x(const std::vector<unsigned char> &input_buffer, const std::string &output_ext, std::vector<unsigned char> &output_buffer,
+		const waifu2xCancelFunc cancel_func = nullptr);
+
+	// fR[hς݂̉摜(cv::imread()œǂݍ񂾂悤CV_8ŨO[XP[ABGRABGRA摜)ϊA`ŕԂ
+	// auto_scale̎JPEGłȂ̂ƂĈ
+	eWaifu2xError waifu2x(const cv::Mat &input_image, cv::Mat &output_image,
+		const waifu2xCancelFunc cancel_func = nullptr);
+
+	// LoadOriginalMat()LoadMat()œǂݍ񂾉摜ϊBwrite_imageWriteMat()ł̂܂܏߂CV_8Ủ摜
+	// ǂݍ݁A݂ʃXbhōsɎg
+	// LoadOriginalMat()œǂݍCV_8Ủ摜n΁A摜Ŝ𕂓_ɕϊRs[Ȃ̂őAȂ
+	eWaifu2xError waifu2x(const cv::Mat &src_image, const bool isJpeg, cv::Mat &write_image,
+		const waifu2xCancelFunc cancel_func = nullptr);
+
+	// ̉摜܂Ƃ߂ĕϊBSẲ摜̃ubN܂Ƃ߂ă~job`gނ̂ŁA摜ʂɕϊ鎞ɑ
+	eWaifu2xError waifu2x(const std::vector<cv::Mat> &src_images, const std::vector<bool> &isJpegs, std::vector<cv::Mat> &write_images,
+		const waifu2xCancelFunc cancel_func = nullptr);
+
+	// fR[hς݂̉摜(CV_8U)ォband_heights̑тɕĕϊAϊтband_funcɓn
+	// _̉摜͑(Ə㉺̗])̕Ȃ̂ŁAȉ摜ł͑т̑傫ɔႷ
+	eWaifu2xError waifu2x(const cv::Mat &input_image, const bool isJpeg, const int band_height, const waifu2xBandFunc band_func,
+		const waifu2xCancelFunc cancel_func = nullptr);
+
+	// тɕĕϊAʂCV_8Ủ摜ɂ܂Ƃ߂ĕԂ
+	eWaifu2xError waifu2x(const cv::Mat &input_image, const bool isJpeg, const int band_height, cv::Mat &output_image,
+		const waifu2xCancelFunc cancel_func = nullptr);
+
+	// init()Ŏw肵ݒ(output_ext".png")
+	RequestOption GetRequestOption() const;
+
+	// request̕ϊɎglbg[N\zĂ
+	// lbg[Ninit(const Waifu2x &)ŏCX^XƋL̂ŁAǂ̃CX^Xł\zɕϊł
+	eWaifu2xError preload(const RequestOption &request);
+
+	// request̐ݒŁẢ摜t@Cϊrequest.output_exť`ŃGR[h
+	// CX^Xmode, noise_level, scale_ratiöႤϊ𑱂čs(lbg[NInitOption::net_cache_num܂ŕێ)
+	eWaifu2xError waifu2x(const RequestOption &request, const std::vector<unsigned char> &input_buffer, std::vector<unsigned char> &output_buffer,
+		const waifu2xCancelFunc cancel_func = nullptr);
+
+	// request̐ݒŁAfR[hς݂̉摜(CV_8U)ϊBoutput_ext͎gȂ
+	eWaifu2xError waifu2x(const RequestOption &request, const cv::Mat &input_image, cv::Mat &output_image,
+		const waifu2xCancelFunc cancel_func = nullptr);
+
+	// input_sizẻ摜ϊ̏o͉摜̑傫
+	cv::Size_<int> GetOutputSize(const cv::Size_<int> &input_size) const;
+
+	// crop_size, batch_sizeŕϊ鎞ɁAlbg[ŇvZɎg(ew̓óAƗpobt@ƃubÑobt@)̊TZ(oCg)
+	// host_bytesɃCAdevice_bytesGPŨ̕ԂBd݂ƕϊ摜͊̕܂܂Ȃ
+	// thread_numprocesscpunative̎̃Xbh̐(0ȂCPU̘_RA)
+	static void EstimateNetMemory(const int crop_size, const int batch_size, const std::string &process, const int thread_num, const int input_plane,
+		uint64_t &host_bytes, uint64_t &device_bytes);
+
+	// InitOption::host_memory_limit_mb, device_memory_limit_mb΁AEstimateNetMemory()̊TZ܂܂batch_sizeAcrop_sizȅɏ
+	// init()ĝƓvZ
+	static void FitBlockSize(const InitOption &option, const std::string &process, int &crop_size, int &batch_size);
+
+	// input_sizechannels`lA1fpixel_bytesoCg̉摜xɕϊ鎞ɁA摜ɎgC̊TZ(oCg)
+	uint64_t EstimateImageMemory(const cv::Size_<int> &input_size, const int channels, const size_t pixel_bytes) const;
+
+	// ۂɎgĂcrop_sizebatch_size(̏ɍ킹ďĂ邱Ƃ)
+	int used_crop_size() const;
+	int used_batch_size() const;
+
 	const std::string& used_process() const;
 
+	// init()Ă(ResetStatistics()Ăł)̓vԂBCPŨXbhŏ܂
+	Statistics GetStatistics() const;
+	void ResetStatistics();
+
 	static cv::Mat LoadMat(const std::string &path);
+	// 摜fR[h܂(CV_8ŨO[XP[ABGRABGRA)ǂݍ
+	static eWaifu2xError LoadOriginalMat(cv::Mat &original_image, const std::string &input_file, Statistics *stat = nullptr);
+	static eWaifu2xError LoadOriginalMat(cv::Mat &original_image, const std::vector<unsigned char> &input_buffer, Statistics *stat = nullptr);
+	// statw肷ƁAfR[hAGR[h(ƕ_ւ̕ϊ)ɂԂZ
+	static eWaifu2xError LoadMat(cv::Mat &float_image, const std::string &input_file, Statistics *stat = nullptr);
+	static eWaifu2xError LoadMat(cv::Mat &float_image, const std::vector<unsigned char> &input_buffer, Statistics *stat = nullptr);
+	static eWaifu2xError WriteMat(const cv::Mat &im, const std::string &output_file, Statistics *stat = nullptr);
+	static eWaifu2xError WriteMat(const cv::Mat &im, const std::string &output_ext, std::vector<unsigned char> &output_buffer, Statistics *stat = nullptr);
+	static bool IsJpeg(const std::string &path);
+	static bool IsJpeg(const std::vector<unsigned char> &input_buffer);
 };
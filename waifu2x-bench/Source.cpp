@@ -0,0 +1,458 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <tclap/CmdLine.h>
+#include <boost/tokenizer.hpp>
+#include <chrono>
+#include <algorithm>
+#include <random>
+#include <map>
+#include "../common/waifu2x.h"
+
+#if defined(WIN32) || defined(WIN64)
+#include <Windows.h>
+#include <Psapi.h>
+#pragma comment(lib, "psapi.lib")
+#elif defined(__linux__)
+#include <fstream>
+#include <string.h>
+#endif
+
+
+// 摜̑傫ƃ`l
+struct BenchImage
+{
+	int width;
+	int height;
+	int channels;
+};
+
+// 1̌v
+struct BenchResult
+{
+	std::string process;
+	// processnative̎̌vZ̐x(ȊOfp32)
+	std::string precision;
+	std::string mode;
+	int crop_size;
+	int batch_size;
+	BenchImage image;
+
+	double init_time;
+	std::vector<double> latencies;
+	Waifu2x::Statistics stat;
+	uint64_t peak_rss;
+	// [hƉ摜fp32ŕϊʂƂPSNR(dB)Bׂ錋ʂΕ̒l
+	double psnr;
+};
+
+// ':'؂̕𕪊
+std::vector<std::string> SplitList(const std::string &str)
+{
+	typedef boost::char_separator<char> char_separator;
+	typedef boost::tokenizer<char_separator> tokenizer;
+
+	char_separator sep(":", "", boost::drop_empty_tokens);
+	tokenizer tokens(str, sep);
+
+	std::vector<std::string> list;
+	for (tokenizer::iterator tok_iter = tokens.begin(); tok_iter != tokens.end(); ++tok_iter)
+		list.push_back(*tok_iter);
+
+	return list;
+}
+
+std::vector<int> SplitIntList(const std::string &str)
+{
+	std::vector<int> list;
+	for (const auto &s : SplitList(str))
+		list.push_back(atoi(s.c_str()));
+
+	return list;
+}
+
+// uxv̕ǂ
+bool ParseSize(const std::string &str, int &width, int &height)
+{
+	return sscanf(str.c_str(), "%dx%d", &width, &height) == 2 && width > 0 && height > 0;
+}
+
+// x`}[Np̉摜
+// Rȉ摜Ǝۂ̉摜Əʂς(̍œKŕRȕȗȂ)̂ŁAOf[VƖ͗lƃmCYd˂
+cv::Mat CreateSyntheticImage(const BenchImage &image, const unsigned int seed)
+{
+	std::mt19937 mt(seed);
+	std::uniform_int_distribution<int> noise(-16, 16);
+
+	cv::Mat im(image.height, image.width, CV_MAKETYPE(CV_8U, image.channels));
+
+	for (int y = 0; y < image.height; y++)
+	{
+		unsigned char *ptr = im.ptr<unsigned char>(y);
+		for (int x = 0; x < image.width; x++)
+		{
+			for (int ch = 0; ch < image.channels; ch++)
+			{
+				int v;
+				if (ch == 3) // At@͍sAE𔼓ɂ
+					v = x < image.width / 2 ? 255 : 128 + (y % 64);
+				else
+				{
+					v = (x * 255 / image.width + y * 255 / image.height) / 2;
+					if (((x / 16) + (y / 16) + ch) % 3 == 0)
+						v = 255 - v;
+					v += noise(mt);
+				}
+
+				ptr[x * image.channels + ch] = (unsigned char)std::min(std::max(v, 0), 255);
+			}
+		}
+	}
+
+	return im;
+}
+
+// vZX̃gp()̃s[NoCgPʂŕԂB擾łȂ0
+uint64_t GetPeakRSS()
+{
+#if defined(WIN32) || defined(WIN64)
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return pmc.PeakWorkingSetSize;
+
+	return 0;
+#elif defined(__linux__)
+	std::ifstream ifs("/proc/self/status");
+	std::string line;
+	while (std::getline(ifs, line))
+	{
+		unsigned long long kb = 0;
+		if (sscanf(line.c_str(), "VmHWM: %llu kB", &kb) == 1)
+			return kb * 1024;
+	}
+
+	return 0;
+#else
+	return 0;
+#endif
+}
+
+// gpʂ̃s[N݂̒lɖ߂(Linux̂)B̃s[Nv邽߂Ɏg
+void ResetPeakRSS()
+{
+#if defined(__linux__)
+	FILE *fp = fopen("/proc/self/clear_refs", "w");
+	if (fp)
+	{
+		fputs("5", fp);
+		fclose(fp);
+	}
+#endif
+}
+
+// 傫CV_8Ủ摜a, bPSNR(dB)BvĂ100Ƃ
+double PSNR(const cv::Mat &a, const cv::Mat &b)
+{
+	const double MaxPSNR = 100.0;
+
+	double sum = 0.0;
+	size_t num = 0;
+	for (int y = 0; y < a.rows; y++)
+	{
+		const unsigned char *pa = a.ptr<unsigned char>(y);
+		const unsigned char *pb = b.ptr<unsigned char>(y);
+		const int n = a.cols * a.channels();
+
+		for (int x = 0; x < n; x++)
+		{
+			const double d = (double)pa[x] - pb[x];
+			sum += d * d;
+		}
+
+		num += n;
+	}
+
+	if (num == 0 || sum == 0.0)
+		return MaxPSNR;
+
+	return std::min(10.0 * log10(255.0 * 255.0 / (sum / num)), MaxPSNR);
+}
+
+// ɕׂv̕Sʐ(ŋߖTʖ@)
+double Percentile(const std::vector<double> &v, const double p)
+{
+	if (v.empty())
+		return 0.0;
+
+	const size_t rank = (size_t)ceil(p / 100.0 * v.size());
+	return v[std::min(std::max(rank, (size_t)1), v.size()) - 1];
+}
+
+void PrintResult(const BenchResult &r, const std::string &format)
+{
+	std::vector<double> latencies = r.latencies;
+	std::sort(latencies.begin(), latencies.end());
+
+	double total = 0.0;
+	for (const auto t : latencies)
+		total += t;
+
+	const double mean = latencies.empty() ? 0.0 : total / latencies.size();
+	const double mpixel = (double)r.image.width * r.image.height / 1000000.0;
+	const double mps = total > 0.0 ? mpixel * latencies.size() / total : 0.0;
+	const double occupancy = r.stat.batch_capacity > 0 ? (double)r.stat.block_num / r.stat.batch_capacity : 0.0;
+	const double forward_ratio = r.stat.forward_time > 0.0 && total > 0.0 ? r.stat.forward_time / total : 0.0;
+
+	if (format == "json")
+	{
+		char psnr[32] = "null";
+		if (r.psnr >= 0.0)
+			sprintf(psnr, "%.4f", r.psnr);
+
+		printf("{\"process\": \"%s\", \"native_precision\": \"%s\", \"mode\": \"%s\", \"crop_size\": %d, \"batch_size\": %d, \"width\": %d, \"height\": %d, \"channels\": %d, "
+			"\"init_time\": %.6f, \"iterations\": %d, \"mean\": %.6f, \"p50\": %.6f, \"p90\": %.6f, \"p99\": %.6f, \"max\": %.6f, "
+			"\"mpixel_per_sec\": %.4f, \"batch_occupancy\": %.4f, \"forward_ratio\": %.4f, \"peak_rss\": %llu, \"psnr\": %s}\n",
+			r.process.c_str(), r.precision.c_str(), r.mode.c_str(), r.crop_size, r.batch_size, r.image.width, r.image.height, r.image.channels,
+			r.init_time, (int)latencies.size(), mean, Percentile(latencies, 50.0), Percentile(latencies, 90.0), Percentile(latencies, 99.0),
+			latencies.empty() ? 0.0 : latencies.back(), mps, occupancy, forward_ratio, (unsigned long long)r.peak_rss, psnr);
+	}
+	else
+	{
+		char psnr[32] = "-";
+		if (r.psnr >= 0.0)
+			sprintf(psnr, "%.2f", r.psnr);
+
+		printf("%-7s %-4s %-12s %5d %5d %5dx%-5d %2d %9.3f %9.3f %9.3f %9.3f %9.3f %6.1f%% %6.1f%% %9.1f %7s\n",
+			r.process.c_str(), r.precision.c_str(), r.mode.c_str(), r.crop_size, r.batch_size, r.image.width, r.image.height, r.image.channels,
+			mps, mean * 1000.0, Percentile(latencies, 50.0) * 1000.0, Percentile(latencies, 90.0) * 1000.0, Percentile(latencies, 99.0) * 1000.0,
+			occupancy * 100.0, forward_ratio * 100.0, r.peak_rss / (1024.0 * 1024.0), psnr);
+	}
+
+	fflush(stdout);
+}
+
+int main(int argc, char** argv)
+{
+	// definition of command line arguments
+	TCLAP::CmdLine cmd("benchmark for waifu2x-caffe", ' ', "1.0.0");
+
+	TCLAP::ValueArg<std::string> cmdSizes("s", "sizes",
+		"sizes of synthetic images (WIDTHxHEIGHT, separated by :)", false, "256x256:1024x768",
+		"string", cmd);
+
+	TCLAP::ValueArg<std::string> cmdChannels("", "channels",
+		"channels of synthetic images (1, 3 or 4, separated by :)", false, "3",
+		"string", cmd);
+
+	TCLAP::ValueArg<std::string> cmdModes("m", "modes",
+		"image processing modes (separated by :)", false, "noise_scale",
+		"string", cmd);
+
+	TCLAP::ValueArg<std::string> cmdProcesses("p", "processes",
+		"process modes (separated by :)", false, "native:cpu",
+		"string", cmd);
+
+	TCLAP::ValueArg<std::string> cmdNativePrecisions("", "native_precisions",
+		"precisions used in native mode (fp32, fp16 or int8, separated by :)", false, "fp32",
+		"string", cmd);
+
+	TCLAP::ValueArg<std::string> cmdCropSizes("c", "crop_sizes",
+		"input image split sizes (separated by :)", false, "128",
+		"string", cmd);
+
+	TCLAP::ValueArg<std::string> cmdBatchSizes("b", "batch_sizes",
+		"input batch sizes (separated by :)", false, "1",
+		"string", cmd);
+
+	TCLAP::ValueArg<int> cmdNRLevel("n", "noise_level", "noise reduction level",
+		false, 1, "int", cmd);
+
+	TCLAP::ValueArg<double> cmdScaleRatio("r", "scale_ratio",
+		"custom scale ratio", false, 2.0, "double", cmd);
+
+	TCLAP::ValueArg<std::string> cmdModelPath("", "model_dir",
+		"path to custom model directory (don't append last / )", false,
+		"models/anime_style_art_rgb", "string", cmd);
+
+	TCLAP::ValueArg<int> cmdCPUThreadNum("", "cpu_thread_num",
+		"number of threads processing blocks in cpu or native mode (0: number of logical cores)", false,
+		1, "int", cmd);
+
+	TCLAP::SwitchArg cmdDeviceResident("", "device_resident",
+		"keep the whole image in GPU memory and cut out / write back blocks there (emulated in host memory with process cpu)", cmd, false);
+
+	TCLAP::ValueArg<int> cmdWarmup("w", "warmup",
+		"number of warm-up iterations (not measured)", false,
+		1, "int", cmd);
+
+	TCLAP::ValueArg<int> cmdIterations("", "iterations",
+		"number of measured iterations", false,
+		5, "int", cmd);
+
+	std::vector<std::string> cmdFormatConstraintV;
+	cmdFormatConstraintV.push_back("text");
+	cmdFormatConstraintV.push_back("json");
+	TCLAP::ValuesConstraint<std::string> cmdFormatConstraint(cmdFormatConstraintV);
+	TCLAP::ValueArg<std::string> cmdFormat("f", "format", "output format",
+		false, "text", &cmdFormatConstraint, cmd);
+
+	// definition of command line argument : end
+
+	try
+	{
+		cmd.parse(argc, argv);
+	}
+	catch (std::exception &e)
+	{
+		printf("G[: %s\n", e.what());
+		return 1;
+	}
+
+	std::vector<BenchImage> images;
+	for (const auto &s : SplitList(cmdSizes.getValue()))
+	{
+		int width, height;
+		if (!ParseSize(s, width, height))
+		{
+			printf("G[: 摜TCYu%svsł\n", s.c_str());
+			return 1;
+		}
+
+		for (const int ch : SplitIntList(cmdChannels.getValue()))
+		{
+			if (ch != 1 && ch != 3 && ch != 4)
+			{
+				printf("G[: `lu%dvsł\n", ch);
+				return 1;
+			}
+
+			BenchImage image;
+			image.width = width;
+			image.height = height;
+			image.channels = ch;
+			images.push_back(image);
+		}
+	}
+
+	const std::vector<std::string> processes = SplitList(cmdProcesses.getValue());
+	const std::vector<std::string> native_precisions = SplitList(cmdNativePrecisions.getValue());
+	const std::vector<std::string> modes = SplitList(cmdModes.getValue());
+	const std::vector<int> crop_sizes = SplitIntList(cmdCropSizes.getValue());
+	const std::vector<int> batch_sizes = SplitIntList(cmdBatchSizes.getValue());
+
+	const int Warmup = std::max(cmdWarmup.getValue(), 0);
+	const int Iterations = std::max(cmdIterations.getValue(), 1);
+	const std::string &Format = cmdFormat.getValue();
+
+	// 摜SĂ̏Ŏg
+	std::vector<cv::Mat> input_images;
+	for (size_t i = 0; i < images.size(); i++)
+		input_images.push_back(CreateSyntheticImage(images[i], (unsigned int)i));
+
+	if (Format == "text")
+	{
+		printf("%-7s %-4s %-12s %5s %5s %11s %2s %9s %9s %9s %9s %9s %7s %7s %9s %7s\n",
+			"process", "prec", "mode", "crop", "batch", "size", "ch", "MP/s", "mean(ms)", "p50(ms)", "p90(ms)", "p99(ms)", "occupy", "forward", "RSS(MiB)", "PSNR");
+	}
+
+	bool isError = false;
+
+	// ([h, 摜)ɁAŏfp32ŕϊʁBPSNRvZɂ
+	std::map<std::pair<std::string, size_t>, cv::Mat> reference_images;
+
+	for (const auto &process : processes)
+	{
+		// xÎׂnative
+		std::vector<std::string> precisions(1, "fp32");
+		if (process == "native")
+			precisions = native_precisions;
+
+		for (const auto &precision : precisions)
+		{
+			for (const auto &mode : modes)
+			{
+				for (const int crop_size : crop_sizes)
+				{
+					for (const int batch_size : batch_sizes)
+					{
+						ResetPeakRSS();
+
+						Waifu2x::InitOption option;
+						option.cpu_thread_num = cmdCPUThreadNum.getValue();
+						option.device_resident = cmdDeviceResident.getValue();
+						option.native_precision = precision;
+
+						const auto InitStartTime = std::chrono::high_resolution_clock::now();
+
+						Waifu2x w;
+						const auto ret = w.init(argc, argv, mode, cmdNRLevel.getValue(), cmdScaleRatio.getValue(), cmdModelPath.getValue(), process,
+							crop_size, batch_size, option);
+						if (ret != Waifu2x::eWaifu2xError_OK)
+						{
+							// GPU̖gpuw肵Ȃǂ͔΂đ
+							printf("G[: process %s(%s), mode %s, crop_size %d, batch_size %dŏɎs܂(G[ %d)\n",
+								process.c_str(), precision.c_str(), mode.c_str(), crop_size, batch_size, (int)ret);
+							isError = true;
+							continue;
+						}
+
+						const double InitTime = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - InitStartTime).count();
+
+						for (size_t i = 0; i < images.size(); i++)
+						{
+							BenchResult r;
+							r.process = w.used_process();
+							r.precision = precision;
+							r.mode = mode;
+							r.crop_size = crop_size;
+							r.batch_size = batch_size;
+							r.image = images[i];
+							r.init_time = InitTime;
+
+							bool isFailed = false;
+
+							cv::Mat output_image;
+							for (int j = 0; j < Warmup && !isFailed; j++)
+								isFailed = w.waifu2x(input_images[i], output_image) != Waifu2x::eWaifu2xError_OK;
+
+							w.ResetStatistics();
+
+							for (int j = 0; j < Iterations && !isFailed; j++)
+							{
+								const auto StartTime = std::chrono::high_resolution_clock::now();
+
+								isFailed = w.waifu2x(input_images[i], output_image) != Waifu2x::eWaifu2xError_OK;
+
+								r.latencies.push_back(std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - StartTime).count());
+							}
+
+							if (isFailed)
+							{
+								printf("G[: process %s, mode %s, 摜 %dx%d̕ϊɎs܂\n", process.c_str(), mode.c_str(), images[i].width, images[i].height);
+								isError = true;
+								continue;
+							}
+
+							r.stat = w.GetStatistics();
+							r.peak_rss = GetPeakRSS();
+
+							const auto key = std::make_pair(mode, i);
+							const auto it = reference_images.find(key);
+							if (it != reference_images.end())
+								r.psnr = PSNR(it->second, output_image);
+							else
+							{
+								r.psnr = -1.0;
+								if (precision == "fp32")
+									reference_images[key] = output_image.clone();
+							}
+
+							PrintResult(r, Format);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	return isError ? 1 : 0;
+}
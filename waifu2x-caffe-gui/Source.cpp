@@ -510,6 +510,8 @@ private:
 				p = "CUDA";
 			else if (p == "cudnn")
 				p = "cuDNN";
+			else if (p == "native")
+				p = "CPU(GW)";
 
 			ptr += sprintf(ptr, "gpvZbT[[h: %s\r\n", p.c_str());
 		}
@@ -696,6 +698,9 @@ public:
 				case Waifu2x::eWaifu2xError_FailedProcessCaffe:
 					sprintf(msg, "ԏɎs܂");
 					break;
+				case Waifu2x::eWaifu2xError_OutOfMemory:
+					sprintf(msg, "u%sv̕ϊɃȂȂ܂", fp.first.c_str());
+					break;
 				}
 			}
 
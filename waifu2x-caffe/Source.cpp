@@ -4,7 +4,15 @@
 #include <boost/foreach.hpp>
 #include <functional>
 #include <boost/tokenizer.hpp>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
 #include "../common/waifu2x.h"
+#include "../common/auto_tune.h"
 
 
 // http://stackoverflow.com/questions/10167382/boostfilesystem-get-relative-path
@@ -47,8 +55,152 @@ boost::filesystem::path relativePath(const boost::filesystem::path &path, const
 	return result;
 }
 
+// eʐt̃XbhZ[tȃL[
+// t̎push()A̎pop()ubN
+template<typename T>
+class BoundedQueue
+{
+private:
+	std::mutex mtx;
+	std::condition_variable cond_push;
+	std::condition_variable cond_pop;
+	std::deque<T> queue;
+	const size_t capacity;
+	bool is_closed;
+
+public:
+	BoundedQueue(const size_t Capacity) : capacity(Capacity), is_closed(false)
+	{
+	}
+
+	void push(T &&v)
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+		cond_push.wait(lock, [this]() { return queue.size() < capacity || is_closed; });
+
+		queue.push_back(std::move(v));
+		cond_pop.notify_one();
+	}
+
+	// close()ꂽɃL[ɂȂfalseԂ
+	bool pop(T &v)
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+		cond_pop.wait(lock, [this]() { return !queue.empty() || is_closed; });
+
+		if (queue.empty())
+			return false;
+
+		v = std::move(queue.front());
+		queue.pop_front();
+		cond_push.notify_one();
+
+		return true;
+	}
+
+	// L[Ȃ炷falseԂ
+	bool try_pop(T &v)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+		if (queue.empty())
+			return false;
+
+		v = std::move(queue.front());
+		queue.pop_front();
+		cond_push.notify_one();
+
+		return true;
+	}
+
+	// ȏpushȂƂʒm
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		is_closed = true;
+
+		cond_push.notify_all();
+		cond_pop.notify_all();
+	}
+};
+
+// pCvC̊eiK̊ԂŎ󂯓nf[^
+struct ConvertJob
+{
+	const std::pair<std::string, std::string> *path;
+	cv::Mat image;
+};
+
+void PrintConvertError(const Waifu2x::eWaifu2xError ret, const std::pair<std::string, std::string> &p)
+{
+	switch (ret)
+	{
+	case Waifu2x::eWaifu2xError_InvalidParameter:
+		printf("G[: p[^sł\n");
+		break;
+	case Waifu2x::eWaifu2xError_FailedOpenInputFile:
+		printf("G[: ͉摜u%svJ܂ł\n", p.first.c_str());
+		break;
+	case Waifu2x::eWaifu2xError_FailedOpenOutputFile:
+		printf("G[: o͉摜u%sv߂܂ł\n", p.second.c_str());
+		break;
+	case Waifu2x::eWaifu2xError_FailedProcessCaffe:
+		printf("G[: ԏɎs܂\n");
+		break;
+	case Waifu2x::eWaifu2xError_OutOfMemory:
+		printf("G[: u%sv̕ϊɃȂȂ܂\n", p.first.c_str());
+		break;
+	}
+}
+
+// ϊ̓vo͂
+// total_time͑Ŝ̌oߎ(b)
+void PrintStatistics(const Waifu2x::Statistics &stat, const std::string &format, const double total_time)
+{
+	const double occupancy = stat.batch_capacity > 0 ? (double)stat.block_num / stat.batch_capacity : 0.0;
+
+	const struct
+	{
+		const char *name;
+		double time;
+	} times[] =
+	{
+		{ "decode", stat.decode_time },
+		{ "color_convert", stat.color_convert_time },
+		{ "padding", stat.padding_time },
+		{ "pack", stat.pack_time },
+		{ "forward", stat.forward_time },
+		{ "unpack", stat.unpack_time },
+		{ "merge", stat.merge_time },
+		{ "encode", stat.encode_time },
+	};
+
+	if (format == "json")
+	{
+		printf("{\"total_time\": %.6f, \"time\": {", total_time);
+		for (size_t i = 0; i < sizeof(times) / sizeof(times[0]); i++)
+			printf("%s\"%s\": %.6f", i > 0 ? ", " : "", times[i].name, times[i].time);
+		printf("}, \"image_num\": %llu, \"block_num\": %llu, \"skip_block_num\": %llu, \"batch_num\": %llu, \"batch_occupancy\": %.4f}\n",
+			(unsigned long long)stat.image_num, (unsigned long long)stat.block_num, (unsigned long long)stat.skip_block_num, (unsigned long long)stat.batch_num, occupancy);
+	}
+	else
+	{
+		printf("v:\n");
+		printf("  Ŝ̎: %.3fb\n", total_time);
+		for (size_t i = 0; i < sizeof(times) / sizeof(times[0]); i++)
+			printf("  %-14s %10.3fb\n", times[i].name, times[i].time);
+		printf("  摜: %llu, ubN: %llu, ~job`: %llu, ~job`̏[U: %.1f%%\n",
+			(unsigned long long)stat.image_num, (unsigned long long)stat.block_num, (unsigned long long)stat.batch_num, occupancy * 100.0);
+		if (stat.skip_block_num > 0)
+			printf("  lbg[Nɒʂɖ߂RȃubN: %llu\n", (unsigned long long)stat.skip_block_num);
+		printf("  (decode, encode͓ǂݏXbhApack, forward, unpack͕ϊXbh̎Ԃ̍vł)\n");
+	}
+}
+
 int main(int argc, char** argv)
 {
+	const auto StartTime = std::chrono::high_resolution_clock::now();
+
 	// definition of command line arguments
 	TCLAP::CmdLine cmd("waifu2x reimplementation using Caffe", ' ', "1.0.0");
 
@@ -91,14 +243,35 @@ int main(int argc, char** argv)
 		"path to custom model directory (don't append last / )", false,
 		"models/anime_style_art_rgb", "string", cmd);
 
+	TCLAP::ValueArg<std::string> cmdModelCacheDir("", "model_cache_dir",
+		"directory to store converted model weights (default: model directory, or the temporary directory if it is not writable)", false,
+		"", "string", cmd);
+
 	std::vector<std::string> cmdProcessConstraintV;
 	cmdProcessConstraintV.push_back("cpu");
 	cmdProcessConstraintV.push_back("gpu");
 	cmdProcessConstraintV.push_back("cudnn");
+	cmdProcessConstraintV.push_back("native");
 	TCLAP::ValuesConstraint<std::string> cmdProcessConstraint(cmdProcessConstraintV);
 	TCLAP::ValueArg<std::string> cmdProcess("p", "process", "process mode",
 		false, "gpu", &cmdProcessConstraint, cmd);
 
+	std::vector<std::string> cmdNativePrecisionConstraintV;
+	cmdNativePrecisionConstraintV.push_back("fp32");
+	cmdNativePrecisionConstraintV.push_back("fp16");
+	cmdNativePrecisionConstraintV.push_back("int8");
+	TCLAP::ValuesConstraint<std::string> cmdNativePrecisionConstraint(cmdNativePrecisionConstraintV);
+	TCLAP::ValueArg<std::string> cmdNativePrecision("", "native_precision", "precision of weights and intermediate images in native mode",
+		false, "fp32", &cmdNativePrecisionConstraint, cmd);
+
+	TCLAP::ValueArg<double> cmdNativeMinPSNR("", "native_min_psnr",
+		"use fp32 instead of native_precision for models whose result differs from fp32 more than this PSNR (dB)", false,
+		30.0, "double", cmd);
+
+	TCLAP::ValueArg<double> cmdMaxResampleScale("", "max_resample_scale",
+		"when scale_ratio is not a power of two, stop at the lower power of two and upscale the rest with bicubic if the rest is at most this ratio (1.0: always overshoot and shrink)", false,
+		1.0, "double", cmd);
+
 	TCLAP::ValueArg<int> cmdCropSizeFile("c", "crop_size",
 		"input image split size", false,
 		128, "int", cmd);
@@ -107,6 +280,51 @@ int main(int argc, char** argv)
 		"input batch size", false,
 		1, "int", cmd);
 
+	TCLAP::SwitchArg cmdAutoTune("", "auto_tune",
+		"when crop_size and batch_size are not given and no tuned values are saved for this machine, measure candidates and save the fastest", cmd, false);
+
+	TCLAP::ValueArg<int> cmdAutoTuneMemory("", "auto_tune_memory",
+		"upper limit in MB of the estimated memory (GPU memory with gpu/cudnn) used by the network when auto tuning (0: no limit)", false,
+		0, "int", cmd);
+
+	TCLAP::ValueArg<int> cmdCPUThreadNum("", "cpu_thread_num",
+		"number of threads processing blocks in cpu or native mode (0: number of logical cores)", false,
+		1, "int", cmd);
+
+	TCLAP::SwitchArg cmdDeviceResident("", "device_resident",
+		"keep the whole image in GPU memory and cut out / write back blocks there (emulated in host memory with process cpu)", cmd, false);
+
+	TCLAP::SwitchArg cmdSkipFlatBlock("", "skip_flat_block",
+		"fill blocks whose surrounding pixels are flat (or fully transparent) with their color instead of running the network", cmd, false);
+
+	TCLAP::ValueArg<float> cmdFlatBlockTolerance("", "flat_block_tolerance",
+		"maximum difference between the largest and smallest value (0-255) of each channel for a block to be treated as flat", false,
+		1.0f, "float", cmd);
+
+	TCLAP::ValueArg<int> cmdIOThreadNum("", "io_thread_num",
+		"number of threads for image decoding and encoding", false,
+		2, "int", cmd);
+
+	std::vector<std::string> cmdPrintStatsConstraintV;
+	cmdPrintStatsConstraintV.push_back("none");
+	cmdPrintStatsConstraintV.push_back("text");
+	cmdPrintStatsConstraintV.push_back("json");
+	TCLAP::ValuesConstraint<std::string> cmdPrintStatsConstraint(cmdPrintStatsConstraintV);
+	TCLAP::ValueArg<std::string> cmdPrintStats("", "print_stats", "print per-stage timings and block counts after conversion",
+		false, "none", &cmdPrintStatsConstraint, cmd);
+
+	TCLAP::ValueArg<int> cmdMemoryLimit("", "memory_limit",
+		"upper limit in MB of host and GPU memory; crop_size and batch_size are reduced and large images are converted in bands to stay within it (0: no limit)", false,
+		0, "int", cmd);
+
+	TCLAP::ValueArg<int> cmdDeviceMemoryLimit("", "device_memory_limit",
+		"upper limit in MB of GPU memory if it differs from memory_limit (0: same as memory_limit)", false,
+		0, "int", cmd);
+
+	TCLAP::ValueArg<int> cmdBandHeight("", "band_height",
+		"convert images in horizontal bands of this many input rows to reduce memory usage (0: whole image at once)", false,
+		0, "int", cmd);
+
 	// definition of command line argument : end
 
 	TCLAP::Arg::enableIgnoreMismatched();
@@ -235,10 +453,69 @@ int main(int argc, char** argv)
 		file_paths.emplace_back(cmdInputFile.getValue(), outputFileName);
 	}
 
+	Waifu2x::InitOption option;
+	option.cpu_thread_num = cmdCPUThreadNum.getValue();
+	option.device_resident = cmdDeviceResident.getValue();
+	option.skip_flat_block = cmdSkipFlatBlock.getValue();
+	option.flat_block_tolerance = std::max(cmdFlatBlockTolerance.getValue(), 0.0f);
+	option.native_precision = cmdNativePrecision.getValue();
+	option.native_min_psnr = cmdNativeMinPSNR.getValue();
+	option.max_resample_scale = cmdMaxResampleScale.getValue();
+	option.host_memory_limit_mb = std::max(cmdMemoryLimit.getValue(), 0);
+	option.device_memory_limit_mb = cmdDeviceMemoryLimit.getValue() > 0 ? cmdDeviceMemoryLimit.getValue() : option.host_memory_limit_mb;
+	option.model_cache_dir = cmdModelCacheDir.getValue();
+
+	int CropSize = std::max(cmdCropSizeFile.getValue(), 1);
+	int BatchSize = std::max(cmdBatchSizeFile.getValue(), 1);
+
+	// crop_sizebatch_size̎w肪΁Ã}VŌvʂ΂g
+	if (!cmdCropSizeFile.isSet() && !cmdBatchSizeFile.isSet())
+	{
+		const std::string tune_path = Waifu2xAutoTune::GetDefaultPath(cmdModelCacheDir.getValue());
+		const std::string tune_key = Waifu2xAutoTune::GetKey(cmdModelPath.getValue(), cmdMode.getValue(), cmdProcess.getValue(), option);
+		const int MemoryBudget = std::max(cmdAutoTuneMemory.getValue(), 0);
+
+		Waifu2xAutoTune::stResult tuned;
+		bool isTuned = Waifu2xAutoTune::Load(tune_path, tune_key, tuned) &&
+			Waifu2xAutoTune::IsInBudget(tuned.crop_size, tuned.batch_size, cmdProcess.getValue(), option.cpu_thread_num, MemoryBudget);
+
+		if (!isTuned && cmdAutoTune.getValue())
+		{
+			printf("crop_sizebatch_sizevĂ܂...\n");
+
+			Waifu2xAutoTune::stOption tune_option;
+			tune_option.memory_budget_mb = MemoryBudget;
+
+			const auto progress_func = [](const Waifu2xAutoTune::stResult &r)
+			{
+				printf("  crop_size %d, batch_size %d: %.3f MP/s\n", r.crop_size, r.batch_size, r.mpixel_per_sec);
+			};
+
+			if (Waifu2xAutoTune::Tune(argc, argv, cmdMode.getValue(), cmdNRLevel.getValue(), cmdModelPath.getValue(), cmdProcess.getValue(),
+				option, tune_option, tuned, progress_func) == Waifu2x::eWaifu2xError_OK)
+			{
+				isTuned = true;
+
+				if (!Waifu2xAutoTune::Save(tune_path, tune_key, tuned))
+					printf("x: vʂu%svɕۑł܂ł\n", tune_path.c_str());
+			}
+			else
+				printf("x: vłgݍ킹܂łBftHg̒lg܂\n");
+		}
+
+		if (isTuned)
+		{
+			CropSize = tuned.crop_size;
+			BatchSize = tuned.batch_size;
+
+			printf("crop_size %d, batch_size %dg܂\n", CropSize, BatchSize);
+		}
+	}
+
 	Waifu2x::eWaifu2xError ret;
 	Waifu2x w;
 	ret = w.init(argc, argv, cmdMode.getValue(), cmdNRLevel.getValue(), cmdScaleRatio.getValue(), cmdModelPath.getValue(), cmdProcess.getValue(),
-		cmdCropSizeFile.getValue(), cmdBatchSizeFile.getValue());
+		CropSize, BatchSize, option);
 	switch (ret)
 	{
 	case Waifu2x::eWaifu2xError_InvalidParameter:
@@ -255,32 +532,197 @@ int main(int argc, char** argv)
 		return 1;
 	}
 
-	bool isError = false;
-	for (const auto &p : file_paths)
+	// ̏ɍ킹ďĂm点
+	if (w.used_crop_size() != CropSize || w.used_batch_size() != BatchSize)
 	{
-		const Waifu2x::eWaifu2xError ret = w.waifu2x(p.first, p.second);
-		if (ret != Waifu2x::eWaifu2xError_OK)
+		CropSize = w.used_crop_size();
+		BatchSize = w.used_batch_size();
+
+		printf("̏ɍ킹crop_size %d, batch_size %dg܂\n", CropSize, BatchSize);
+	}
+
+	// 摜̓ǂݍ݁AϊA݂ʃXbhŕsčs
+	// ϊinit()Ă񂾃CXbhōs
+	const int IOThreadNum = std::max(cmdIOThreadNum.getValue(), 1);
+
+	// 摜̓ubN̐𒴂܂ł܂Ƃ߂ĕϊ(~job`𖄂߂邽)
+	const int GatherBlockNum = BatchSize * 2;
+
+	// 0傫Ή摜тɕĈꖇϊ
+	const int BandHeight = std::max(cmdBandHeight.getValue(), 0);
+
+	// тɕĕϊ鎞͋ȉ摜z肵Ă̂ŁAL[ɗ߂摜ŏɂ
+	BoundedQueue<ConvertJob> decode_queue(BandHeight > 0 ? 1 : std::max(IOThreadNum * 2, GatherBlockNum));
+	BoundedQueue<ConvertJob> encode_queue(BandHeight > 0 ? 1 : IOThreadNum * 2);
+
+	std::atomic<bool> isError(false);
+	std::atomic<size_t> decode_index(0);
+	std::atomic<int> decode_running(IOThreadNum);
+
+	// ǂݍ݁A݃Xbh̓v̓XbhɏW߂āAIɑ킹
+	std::mutex io_stat_mtx;
+	Waifu2x::Statistics io_stat;
+
+	std::vector<std::thread> io_threads;
+	for (int i = 0; i < IOThreadNum; i++)
+	{
+		io_threads.emplace_back([&]()
 		{
-			switch (ret)
+			Waifu2x::Statistics stat;
+
+			for (;;)
 			{
-			case Waifu2x::eWaifu2xError_InvalidParameter:
-				printf("G[: p[^sł\n");
-				break;
-			case Waifu2x::eWaifu2xError_FailedOpenInputFile:
-				printf("G[: ͉摜u%svJ܂ł\n", p.first.c_str());
-				break;
-			case Waifu2x::eWaifu2xError_FailedOpenOutputFile:
-				printf("G[: o͉摜u%sv߂܂ł\n", p.second.c_str());
-				break;
-			case Waifu2x::eWaifu2xError_FailedProcessCaffe:
-				printf("G[: ԏɎs܂\n");
+				const size_t index = decode_index++;
+				if (index >= file_paths.size())
+					break;
+
+				ConvertJob job;
+				job.path = &file_paths[index];
+
+				// _ɂ͕ϊɃfR[h܂ܓn(ϊ̓lbg[Nɓ͂摜鎞ɍs)
+				const Waifu2x::eWaifu2xError ret = Waifu2x::LoadOriginalMat(job.image, job.path->first, &stat);
+				if (ret != Waifu2x::eWaifu2xError_OK)
+				{
+					PrintConvertError(ret, *job.path);
+					isError = true;
+					continue;
+				}
+
+				decode_queue.push(std::move(job));
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(io_stat_mtx);
+				io_stat += stat;
+			}
+
+			// ŌɏIǂݍ݃XbhL[
+			if (--decode_running == 0)
+				decode_queue.close();
+		});
+
+		io_threads.emplace_back([&]()
+		{
+			Waifu2x::Statistics stat;
+
+			ConvertJob job;
+			while (encode_queue.pop(job))
+			{
+				const Waifu2x::eWaifu2xError ret = Waifu2x::WriteMat(job.image, job.path->second, &stat);
+				job.image.release();
+
+				if (ret != Waifu2x::eWaifu2xError_OK)
+				{
+					PrintConvertError(ret, *job.path);
+					isError = true;
+				}
+			}
+
+			std::lock_guard<std::mutex> lock(io_stat_mtx);
+			io_stat += stat;
+		});
+	}
+
+	std::vector<ConvertJob> jobs;
+	ConvertJob job;
+	while (decode_queue.pop(job))
+	{
+		if (BandHeight > 0)
+		{
+			cv::Mat write_image;
+			const Waifu2x::eWaifu2xError ret = w.waifu2x(job.image, Waifu2x::IsJpeg(job.path->first), BandHeight, write_image);
+			job.image.release();
+
+			if (ret != Waifu2x::eWaifu2xError_OK)
+			{
+				PrintConvertError(ret, *job.path);
+				isError = true;
+				continue;
+			}
+
+			job.image = write_image;
+			encode_queue.push(std::move(job));
+			continue;
+		}
+
+		// ǂݍݍς݂̉摜ubNGatherBlockNumɒB܂ŏW߂
+		jobs.clear();
+		int blockNum = 0;
+		for (;;)
+		{
+			const cv::Size size = job.image.size();
+			blockNum += ((size.width + CropSize - 1) / CropSize) * ((size.height + CropSize - 1) / CropSize);
+
+			jobs.push_back(std::move(job));
+
+			if (blockNum >= GatherBlockNum || !decode_queue.try_pop(job))
 				break;
+		}
+
+		std::vector<cv::Mat> src_images;
+		std::vector<bool> isJpegs;
+		for (const auto &j : jobs)
+		{
+			src_images.push_back(j.image);
+			isJpegs.push_back(Waifu2x::IsJpeg(j.path->first));
+		}
+
+		std::vector<cv::Mat> write_images;
+		Waifu2x::eWaifu2xError ret = w.waifu2x(src_images, isJpegs, write_images);
+		src_images.clear();
+
+		if (ret == Waifu2x::eWaifu2xError_OK)
+		{
+			for (size_t i = 0; i < jobs.size(); i++)
+			{
+				jobs[i].image = write_images[i];
+				encode_queue.push(std::move(jobs[i]));
 			}
+			continue;
+		}
 
+		if (jobs.size() == 1)
+		{
+			PrintConvertError(ret, *jobs[0].path);
 			isError = true;
+			continue;
+		}
+
+		// ǂ̉摜ŎsȂ̂ŁA1ϊĎs摜G[ɂ
+		for (auto &j : jobs)
+		{
+			const std::vector<cv::Mat> src_image(1, j.image);
+			const std::vector<bool> isJpeg(1, Waifu2x::IsJpeg(j.path->first));
+			j.image.release();
+
+			write_images.clear();
+			ret = w.waifu2x(src_image, isJpeg, write_images);
+			if (ret != Waifu2x::eWaifu2xError_OK)
+			{
+				PrintConvertError(ret, *j.path);
+				isError = true;
+				continue;
+			}
+
+			j.image = write_images[0];
+			encode_queue.push(std::move(j));
 		}
 	}
 
+	encode_queue.close();
+
+	for (auto &t : io_threads)
+		t.join();
+
+	if (cmdPrintStats.getValue() != "none")
+	{
+		Waifu2x::Statistics stat = w.GetStatistics();
+		stat += io_stat;
+
+		const double TotalTime = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - StartTime).count();
+		PrintStatistics(stat, cmdPrintStats.getValue(), TotalTime);
+	}
+
 	if (isError)
 	{
 		printf("ϊɎst@C܂\n");